@@ -0,0 +1,91 @@
+/*
+ * Fit search on a fragmented heap: the free block index against the linked free lists.
+ * An mmap-backed heap is filled with HOLES pairs of a 384-byte block and a 64-byte
+ * block, about 28 MiB, and the 384-byte blocks are freed, so one size class holds
+ * a long list of holes that are all too small.  Each request for 512 bytes then
+ * has to look at every one of them before it falls through to the wilderness.
+ *
+ * Built with make perf, the hardware counters for each variant are printed too.
+ * They cover only the timed requests, not the fragmenting.  The holes span far
+ * more than the caches and the TLB, so expect the list walk to miss in L1d, the
+ * LLC and the dTLB at every few holes, while the index reads a dense array.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfpage.h"
+#include "sfperf.h"
+
+#define HOLE_SIZE (384 - 8)
+#define PIN_SIZE (64 - 8)
+#define REQUEST_SIZE (512 - 8)
+#define HOLES 65536
+#define RESERVE (64 << 20)
+#define ROUNDS 500
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// returns the number of holes made
+static int fragment(void) {
+    static void *holes[HOLES];
+    int n = 0;
+    while (n < HOLES) {
+        holes[n] = sf_malloc(HOLE_SIZE);
+        if (holes[n] == NULL) {
+            break;
+        }
+        // the pin keeps the hole from merging with the next one
+        if (sf_malloc(PIN_SIZE) == NULL) {
+            sf_free(holes[n]);
+            break;
+        }
+        n++;
+    }
+    int i;
+    for (i = 0; i < n; i++) {
+        sf_free(holes[i]);
+    }
+    return n;
+}
+
+static double run(const char *name, int use_index, int *holes) {
+    // a fresh heap every time
+    sf_set_page_provider(&sf_mmap_pages, RESERVE);
+    sf_use_fit_index = use_index;
+    *holes = fragment();
+    sf_perf_reset();
+    double start = now();
+    int r;
+    for (r = 0; r < ROUNDS; r++) {
+        void *p = sf_malloc(REQUEST_SIZE);
+        if (p == NULL) {
+            fprintf(stderr, "request failed\n");
+            exit(EXIT_FAILURE);
+        }
+        sf_free(p);
+    }
+    double t = now() - start;
+    char title[64];
+    snprintf(title, sizeof(title), "%s, %d holes", name, *holes);
+    sf_perf_dump(stdout, title);
+    return t;
+}
+
+int main(int argc, char const *argv[]) {
+    int holes_list, holes_index;
+    sf_perf_open(); // without SF_PERF, or without counters, only the times are printed
+    double t_list = run("linked lists", 0, &holes_list);
+    double t_index = run("fit index", 1, &holes_index);
+    sf_set_page_provider(&sf_sfutil_pages, 0);
+    printf("%d holes, %d malloc/free pairs\n", holes_index, ROUNDS);
+    printf("%-16s %10.3f ms %8.2f ns/pair\n", "linked lists", t_list * 1e3, t_list * 1e9 / ROUNDS);
+    printf("%-16s %10.3f ms %8.2f ns/pair\n", "fit index", t_index * 1e3, t_index * 1e9 / ROUNDS);
+    return EXIT_SUCCESS;
+}
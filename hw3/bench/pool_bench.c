@@ -0,0 +1,125 @@
+/*
+ * Compares a fixed-size pool against sf_malloc/sf_free for the same object size,
+ * with sf_malloc called both directly and through the constant-size SF_MALLOC.
+ * Each round allocates a batch of objects, frees every other one, refills the
+ * holes and then frees everything, so both allocators see reuse as well as growth.
+ * The sf_malloc run is repeated with guarded sampling on at its default rate.
+ * Built with make perf, the hardware counters for each workload are printed too.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfmm_inline.h"
+#include "sfpool.h"
+#include "sfguard.h"
+#include "sfperf.h"
+
+#define OBJ_SIZE 48
+#define BATCH 400
+#define ROUNDS 20000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *objs[BATCH];
+
+static double run_malloc(void) {
+    double start = now();
+    int r, i;
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < BATCH; i++)
+            objs[i] = sf_malloc(OBJ_SIZE);
+        for (i = 0; i < BATCH; i += 2)
+            sf_free(objs[i]);
+        for (i = 0; i < BATCH; i += 2)
+            objs[i] = sf_malloc(OBJ_SIZE);
+        for (i = 0; i < BATCH; i++)
+            sf_free(objs[i]);
+    }
+    return now() - start;
+}
+
+static double run_malloc_inline(void) {
+    double start = now();
+    int r, i;
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < BATCH; i++)
+            objs[i] = SF_MALLOC(OBJ_SIZE);
+        for (i = 0; i < BATCH; i += 2)
+            sf_free(objs[i]);
+        for (i = 0; i < BATCH; i += 2)
+            objs[i] = SF_MALLOC(OBJ_SIZE);
+        for (i = 0; i < BATCH; i++)
+            sf_free(objs[i]);
+    }
+    return now() - start;
+}
+
+static double run_pool(sf_pool *pool) {
+    double start = now();
+    int r, i;
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < BATCH; i++)
+            objs[i] = sf_pool_alloc(pool);
+        for (i = 0; i < BATCH; i += 2)
+            sf_pool_free(pool, objs[i]);
+        for (i = 0; i < BATCH; i += 2)
+            objs[i] = sf_pool_alloc(pool);
+        for (i = 0; i < BATCH; i++)
+            sf_pool_free(pool, objs[i]);
+    }
+    return now() - start;
+}
+
+int main(int argc, char const *argv[]) {
+    long ops = (long)ROUNDS * BATCH * 3;
+
+    sf_perf_open(); // without SF_PERF, or without counters, only the times are printed
+    sf_mem_init();
+    sf_perf_reset();
+    double t_malloc = run_malloc();
+    sf_perf_dump(stdout, "sf_malloc/free");
+    sf_mem_fini();
+
+    sf_mem_init();
+    sf_perf_reset();
+    double t_inline = run_malloc_inline();
+    sf_perf_dump(stdout, "SF_MALLOC/free");
+    sf_mem_fini();
+
+    sf_mem_init();
+    sf_pool *pool = sf_pool_create(OBJ_SIZE, 0);
+    if (pool == NULL) {
+        fprintf(stderr, "sf_pool_create failed\n");
+        return EXIT_FAILURE;
+    }
+    sf_perf_reset();
+    double t_pool = run_pool(pool);
+    sf_perf_dump(stdout, "sf_pool");
+    sf_pool_destroy(pool);
+    sf_mem_fini();
+
+    if (sf_guard_start(0, 0) < 0) {
+        fprintf(stderr, "sf_guard_start failed\n");
+        return EXIT_FAILURE;
+    }
+    sf_mem_init();
+    sf_perf_reset();
+    double t_guard = run_malloc();
+    sf_perf_dump(stdout, "sf_malloc/free guarded");
+    sf_guard_stop();
+    sf_mem_fini();
+
+    printf("object size %d, %ld operations\n", OBJ_SIZE, ops);
+    printf("%-16s %10.3f ms %8.2f ns/op\n", "sf_malloc/free", t_malloc * 1e3, t_malloc * 1e9 / ops);
+    printf("%-16s %10.3f ms %8.2f ns/op\n", "SF_MALLOC/free", t_inline * 1e3, t_inline * 1e9 / ops);
+    printf("%-16s %10.3f ms %8.2f ns/op\n", "sf_pool", t_pool * 1e3, t_pool * 1e9 / ops);
+    printf("%-16s %10.3f ms %8.2f ns/op  (1 in %d guarded)\n", "sf_malloc/free", t_guard * 1e3,
+           t_guard * 1e9 / ops, SF_GUARD_DEFAULT_RATE);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/*
+ * Worst-case latency of single calls, with the ordinary heap and with a real-time
+ * heap set up by sf_rt_init, under patterns chosen to hit the slow paths:
+ *
+ *   holes     a long list of holes just too small for every request (fit search)
+ *   growth    ever larger live blocks, so the ordinary heap keeps growing
+ *   churn     random sizes allocated and freed at random, up to a full heap
+ *   realloc   two buffers grown a row at a time in turn, each in the other's way
+ *   none      churn, but timing an empty statement next to each call instead of
+ *             the call, for the noise of the machine itself
+ *
+ * Every call is timed on its own.  Each pattern runs REPS times on a fresh heap;
+ * the worst case printed is the smallest of the per-run maxima, so a one-off
+ * interrupt or preemption in one run does not stand in for the allocator.  Long
+ * runs still see interrupts in every run, so compare worst against the none row.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfpage.h"
+
+#define RT_HEAP (32 << 20)
+#define RESERVE (128 << 20)
+#define REPS 5
+#define MAX_SAMPLES (1 << 20)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UNIT "cycles"
+static uint64_t ticks(void) {
+    return __builtin_ia32_rdtsc();
+}
+#else
+#define UNIT "ns"
+static uint64_t ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static uint64_t samples[MAX_SAMPLES];
+static size_t num_samples;
+static size_t num_failed;
+
+#define TIMED(expr) \
+    do { \
+        uint64_t t0_ = ticks(); \
+        expr; \
+        uint64_t t1_ = ticks(); \
+        if (num_samples < MAX_SAMPLES) \
+            samples[num_samples++] = t1_ - t0_; \
+    } while (0)
+
+static void *timed_malloc(size_t size) {
+    void *p;
+    TIMED(p = sf_malloc(size));
+    num_failed += p == NULL;
+    return p;
+}
+
+static void timed_free(void *p) {
+    if (p != NULL) {
+        TIMED(sf_free(p));
+    }
+}
+
+static uint64_t rng = 88172645463325252ull;
+
+static uint64_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+#define HOLES 4096
+#define HOLE_ROUNDS 20000
+
+static void holes(void) {
+    static void *hole[HOLES];
+    int i;
+    for (i = 0; i < HOLES; i++) {
+        hole[i] = sf_malloc(384 - 8);
+        sf_malloc(64 - 8);
+    }
+    for (i = 0; i < HOLES; i++) {
+        sf_free(hole[i]);
+    }
+    for (i = 0; i < HOLE_ROUNDS; i++) {
+        timed_free(timed_malloc(512 - 8));
+    }
+}
+
+#define GROWTH_BLOCKS 128
+
+static void growth(void) {
+    static void *live[GROWTH_BLOCKS];
+    int i;
+    // 64 KiB to 256 KiB each, about 20 MiB in all
+    for (i = 0; i < GROWTH_BLOCKS; i++) {
+        live[i] = timed_malloc((size_t)(i % 4 + 1) << 16);
+    }
+    for (i = 0; i < GROWTH_BLOCKS; i++) {
+        timed_free(live[i]);
+    }
+}
+
+#define SLOTS 4096
+#define CHURN_ROUNDS 200000
+
+static void churn_timed(int time_calls) {
+    static void *slot[SLOTS];
+    int i;
+    for (i = 0; i < SLOTS; i++) {
+        slot[i] = NULL;
+    }
+    for (i = 0; i < CHURN_ROUNDS; i++) {
+        uint64_t r = next_rand();
+        void **s = &slot[r % SLOTS];
+        if (!time_calls) {
+            TIMED(__asm__ volatile("" ::: "memory"));
+        }
+        if (*s != NULL) {
+            if (time_calls) {
+                timed_free(*s);
+            } else {
+                sf_free(*s);
+            }
+            *s = NULL;
+        } else {
+            // mostly small, now and then up to 64 KiB
+            size_t size = (r >> 32) % 16 == 0 ? 1 + (r >> 40) % 65536 : 1 + (r >> 40) % 1024;
+            *s = time_calls ? timed_malloc(size) : sf_malloc(size);
+        }
+    }
+    for (i = 0; i < SLOTS; i++) {
+        if (slot[i] != NULL) {
+            sf_free(slot[i]);
+        }
+    }
+}
+
+static void churn(void) {
+    churn_timed(1);
+}
+
+static void none(void) {
+    churn_timed(0);
+}
+
+#define REALLOC_LIMIT (128 << 10)
+
+// grows a and b a row at a time in turn, so whichever is lower is always blocked
+static void realloc_rows(void) {
+    char *buf[2] = { sf_malloc(64), sf_malloc(64) };
+    size_t size = 64;
+    while (buf[0] != NULL && buf[1] != NULL && size < REALLOC_LIMIT) {
+        size += 64;
+        int i;
+        for (i = 0; i < 2; i++) {
+            char *p;
+            TIMED(p = sf_realloc(buf[i], size));
+            if (p == NULL) {
+                // real-time mode does not move blocks; move it by hand, untimed
+                num_failed++;
+                p = sf_malloc(size);
+                if (p != NULL) {
+                    sf_free(buf[i]);
+                }
+            }
+            buf[i] = p;
+        }
+    }
+    sf_free(buf[0]);
+    sf_free(buf[1]);
+}
+
+static int by_value(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(const char *name, void (*pattern)(void), int rt) {
+    uint64_t worst = UINT64_MAX, median = 0, p999 = 0;
+    size_t calls = 0, failed = 0;
+    int rep;
+    for (rep = 0; rep < REPS; rep++) {
+        // a fresh heap every time
+        sf_set_page_provider(&sf_mmap_pages, RESERVE);
+        if (rt && sf_rt_init(RT_HEAP) < 0) {
+            fprintf(stderr, "sf_rt_init failed\n");
+            exit(EXIT_FAILURE);
+        }
+        num_samples = 0;
+        num_failed = 0;
+        pattern();
+        if (num_samples == 0) {
+            continue;
+        }
+        qsort(samples, num_samples, sizeof(uint64_t), by_value);
+        if (samples[num_samples - 1] < worst) {
+            worst = samples[num_samples - 1];
+        }
+        median = samples[num_samples / 2];
+        p999 = samples[num_samples - 1 - num_samples / 1000];
+        calls = num_samples;
+        failed = num_failed;
+    }
+    printf("%-10s %-10s %8zu %8zu %10llu %10llu %10llu\n", name, rt ? "real-time" : "ordinary", calls, failed,
+           (unsigned long long)median, (unsigned long long)p999, (unsigned long long)worst);
+}
+
+int main(int argc, char const *argv[]) {
+    static const struct {
+        const char *name;
+        void (*fn)(void);
+    } patterns[] = {
+        { "holes", holes }, { "growth", growth }, { "churn", churn }, { "realloc", realloc_rows },
+        { "none", none },
+    };
+    size_t i;
+    printf("per call, in %s; worst is the best of %d runs\n", UNIT, REPS);
+    printf("%-10s %-10s %8s %8s %10s %10s %10s\n", "pattern", "heap", "calls", "failed", "median", "p99.9", "worst");
+    for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        run(patterns[i].name, patterns[i].fn, 0);
+        run(patterns[i].name, patterns[i].fn, 1);
+    }
+    printf("failed: calls that returned NULL.  A real-time sf_malloc fails when none of the first %d\n"
+           "blocks of each list it looks at fits, even with a fitting block deeper in the list;\n"
+           "a real-time sf_realloc fails when the block would have to move.\n", SF_RT_SEARCH_DEPTH);
+    sf_set_page_provider(&sf_sfutil_pages, 0);
+    return EXIT_SUCCESS;
+}
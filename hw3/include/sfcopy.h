@@ -0,0 +1,47 @@
+/*
+ * Copy and zero kernels for moving payloads around.
+ * Above sf_copy_nt_threshold bytes, sf_copy and sf_zero write with non-temporal
+ * (streaming) stores, which bypass the cache: a large payload that is being
+ * moved or cleared is usually not read again right away, and streaming it keeps
+ * the rest of the working set in cache.  They use the widest vector unit the CPU
+ * has, picked the first time they are called.  Smaller sizes go to libc.
+ */
+#ifndef SFCOPY_H
+#define SFCOPY_H
+#include <stddef.h>
+
+#define SF_ISA_GENERIC  0   // libc memmove/memset at every size
+#define SF_ISA_SSE2     1
+#define SF_ISA_AVX2     2
+#define SF_ISA_AVX512   3
+#define SF_NUM_ISAS     4
+
+/* Copies this large and up use streaming stores; settable for tuning.  Default 1 MiB. */
+extern size_t sf_copy_nt_threshold;
+
+/*
+ * Copies n bytes from src to dst.  The ranges may overlap only if dst is below
+ * src, as when sliding a block down the heap.
+ */
+void sf_copy(void *dst, const void *src, size_t n);
+
+/*
+ * Sets n bytes at dst to zero.
+ */
+void sf_zero(void *dst, size_t n);
+
+/*
+ * Makes sf_copy and sf_zero use the kernels for isa (one of SF_ISA_*), or the
+ * best available one if isa is -1.
+ *
+ * @return 0, or -1 if the CPU does not support isa.
+ */
+int sf_copy_select(int isa);
+
+/*
+ * @return The SF_ISA_* in use, and its name.
+ */
+int sf_copy_isa(void);
+const char *sf_copy_isa_name(int isa);
+
+#endif
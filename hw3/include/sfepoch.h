@@ -0,0 +1,48 @@
+/*
+ * Epoch-based deferred reclamation.
+ * Lock-free structures cannot sf_free a node that other threads may still be
+ * reading.  Readers wrap each access in sf_epoch_enter/sf_epoch_exit; a writer
+ * that unlinks a node hands it to sf_retire, and the node is only freed once
+ * every thread that could have seen it has left its read section.  Retired
+ * blocks wait in per-thread bags and are freed a bag at a time through
+ * sf_free_batch.
+ */
+#ifndef SFEPOCH_H
+#define SFEPOCH_H
+#include <stddef.h>
+
+/* Retires between attempts to advance the epoch and reclaim. */
+#define SF_EPOCH_BATCH 64
+
+/*
+ * Starts a read section.  Sections nest; only the outermost pair counts.
+ *
+ * @return 0, or -1 with sf_errno set to ENOMEM if the calling thread could not
+ * be registered.
+ */
+int sf_epoch_enter(void);
+
+/*
+ * Ends the read section started by the matching sf_epoch_enter.
+ */
+void sf_epoch_exit(void);
+
+/*
+ * Frees the sfmm block at pp once no read section that was running when it was
+ * retired is still running.  May be called inside or outside a read section.
+ *
+ * @return 0, or -1 with sf_errno set to ENOMEM if the block could not be queued;
+ * it is then still allocated and the caller still owns it.
+ */
+int sf_retire(void *pp);
+
+/*
+ * Tries to advance the epoch and frees every block the calling thread retired
+ * that is now safe to free.  Calling it outside a read section lets the epoch
+ * advance past the caller.
+ *
+ * @return The number of blocks freed.
+ */
+size_t sf_epoch_reclaim(void);
+
+#endif
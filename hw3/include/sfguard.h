@@ -0,0 +1,72 @@
+/*
+ * Sampled guard-page allocations, for catching heap corruption in production.
+ * Once sf_guard_start has been called, about one in every rate calls to
+ * sf_malloc, sf_calloc or SF_MALLOC for at most a page is served from a separate
+ * pool of slots instead of the heap.  Each slot is one page with an inaccessible
+ * guard page on either side, and the block is put at the start or at the end of
+ * it at random.  A freed slot is made inaccessible and is only reused after every
+ * other free slot has been, so it stays protected for as long as the pool allows.
+ *
+ * An access just past either end of a guarded block, or to a guarded block after
+ * it was freed, faults at once.  The fault is reported on stderr with where the
+ * block was allocated and freed, and then handled as it would have been without
+ * the pool (by default, the process dies of SIGSEGV).  Freeing a guarded block
+ * twice, or a pointer into the pool that is not a guarded block, is reported the
+ * same way and aborts.
+ *
+ * Blocks stay 64-byte aligned, so an overflow that stays within the rounding of
+ * the size to a multiple of 64 is not caught.  Stacks are taken with
+ * backtrace(3); link with -rdynamic to have them show function names.  A guarded
+ * block keeps its tag for sf_tag_of, but is left out of the counts (sftag.h), and
+ * sf_realloc always moves it back to the heap.
+ *
+ * Sampling is off in real-time mode: sf_rt_init stops it, and sf_guard_start
+ * will not start it while the mode lasts.
+ *
+ * With the pool set up, an unsampled sf_malloc costs one decrement of a thread
+ * local counter and sf_free one compare; a sampled one a few system calls.
+ */
+#ifndef SFGUARD_H
+#define SFGUARD_H
+#include <stddef.h>
+
+#define SF_GUARD_DEFAULT_SLOTS 64
+#define SF_GUARD_DEFAULT_RATE 5000
+#define SF_GUARD_FRAMES 16          // stack frames kept per allocation and free
+
+typedef struct sf_guard_stats {
+    size_t slots;
+    size_t live;                    // guarded blocks allocated now
+    size_t sampled;                 // allocations served from the pool
+    size_t missed;                  // sampled allocations left to the heap: too big or no free slot
+} sf_guard_stats;
+
+/*
+ * Sets up the pool, if it is not already, installs the fault handler for SIGSEGV
+ * and SIGBUS (keeping any handler already installed for faults elsewhere) and
+ * starts sampling in every thread.
+ *
+ * @param slots The number of slots; 0 for SF_GUARD_DEFAULT_SLOTS.  Ignored if the
+ * pool was set up before.
+ * @param rate One in this many allocations is sampled, on average; 0 for
+ * SF_GUARD_DEFAULT_RATE.  1 samples every allocation the pool has room for.
+ *
+ * @return 0 on success.  -1 with sf_errno set to EBUSY if sampling is already on
+ * or the heap is in real-time mode (sf_rt_init), or ENOMEM if the pool could not
+ * be mapped.
+ */
+int sf_guard_start(size_t slots, unsigned rate);
+
+/*
+ * Stops sampling.  The pool stays, so guarded blocks still allocated keep their
+ * guards and can be freed as usual; sf_guard_start starts sampling again.
+ */
+void sf_guard_stop(void);
+
+/* @return Nonzero if pp points into the guarded pool. */
+int sf_guard_owns(const void *pp);
+
+/* Fills in stats; all zero if the pool was never set up. */
+void sf_guard_get_stats(sf_guard_stats *stats);
+
+#endif
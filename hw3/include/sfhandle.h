@@ -0,0 +1,53 @@
+/*
+ * Relocatable allocations.
+ * A handle-backed block is reached through an opaque handle instead of a raw
+ * pointer, so sf_compact() is free to move it while it is not locked.
+ */
+#ifndef SFHANDLE_H
+#define SFHANDLE_H
+#include <stddef.h>
+
+typedef struct sf_hentry *sf_handle;
+
+/*
+ * Allocates a relocatable block.
+ *
+ * @param size The number of bytes requested to be allocated.
+ *
+ * @return If size is 0, then NULL is returned without setting sf_errno.
+ * If the allocation is not successful, then NULL is returned and sf_errno is
+ * set to ENOMEM.  Otherwise a handle to the block is returned.
+ */
+sf_handle sf_halloc(size_t size);
+
+/*
+ * Pins the block behind a handle so that it cannot move.
+ * Locks nest: the block stays pinned until every sf_hlock has been matched by
+ * an sf_hunlock.
+ *
+ * @return The current address of the payload, valid until the matching sf_hunlock.
+ */
+void *sf_hlock(sf_handle h);
+
+/*
+ * Releases one lock taken by sf_hlock.
+ */
+void sf_hunlock(sf_handle h);
+
+/*
+ * Frees the block behind a handle and the handle itself.
+ * If h is NULL or still locked, the function calls abort() to exit the program.
+ */
+void sf_hfree(sf_handle h);
+
+/*
+ * Slides every unlocked handle-backed block down toward the prologue, into the
+ * free block immediately below it, so that free space collects above it and
+ * finally merges into the wilderness.  Blocks that are not handle-backed, or
+ * are locked, stay where they are.
+ *
+ * @return The number of blocks moved.
+ */
+size_t sf_compact(void);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Per-operation latency histograms.
+ * When the allocator is built with SF_HIST defined (make hist), every call to
+ * sf_malloc, sf_free, sf_realloc and sf_memalign is timed with the CPU cycle
+ * counter and counted in a log2-bucketed histogram.  Each bucket also counts how
+ * many of its calls grew the heap, split a block, coalesced or copied a payload.
+ * Without SF_HIST nothing is recorded and the histograms stay empty.
+ */
+#ifndef SFHIST_H
+#define SFHIST_H
+#include <stdint.h>
+#include <stdio.h>
+
+#define SF_OP_MALLOC    0
+#define SF_OP_FREE      1
+#define SF_OP_REALLOC   2
+#define SF_OP_MEMALIGN  3
+#define SF_NUM_OPS      4
+
+/* What happened during a call, as recorded in its bucket. */
+#define SF_EV_GROW      0x1
+#define SF_EV_SPLIT     0x2
+#define SF_EV_COALESCE  0x4
+#define SF_EV_COPY      0x8
+
+/* Bucket b counts calls that took [2^b, 2^(b+1)) cycles; bucket 0 also takes 0. */
+#define SF_HIST_BUCKETS 40
+
+typedef struct sf_hist_bucket {
+    uint64_t calls;
+    uint64_t grew;
+    uint64_t split;
+    uint64_t coalesced;
+    uint64_t copied;
+} sf_hist_bucket;
+
+typedef struct sf_hist {
+    uint64_t calls;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    sf_hist_bucket buckets[SF_HIST_BUCKETS];
+} sf_hist;
+
+/*
+ * @return The histogram for one of the SF_OP_* operations, or NULL if op is out of range.
+ */
+const sf_hist *sf_hist_get(int op);
+
+/*
+ * Clears every histogram.
+ */
+void sf_hist_reset(void);
+
+/*
+ * Writes every histogram that has calls in it to out as text.
+ */
+void sf_hist_dump(FILE *out);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Extensions to the sfmm interface.
+ * sfmm.h must stay exactly as handed out, so prototypes for anything beyond
+ * sf_malloc/sf_realloc/sf_free/sf_memalign live here instead.
+ */
+#ifndef SFMM_EXT_H
+#define SFMM_EXT_H
+#include <stddef.h>
+#include "sfmm.h"
+
+/*
+ * Allocates zero-filled memory for an array of nmemb elements of size bytes each.
+ *
+ * Only bytes that might have been written before are cleared: the part of the
+ * wilderness that has never been touched since it was handed over as zero-filled
+ * memory is left alone.
+ *
+ * @param nmemb The number of elements.
+ * @param size The size of each element in bytes.
+ *
+ * @return If nmemb or size is 0, then NULL is returned without setting sf_errno.
+ * If nmemb * size overflows, or the allocation is not successful, then NULL is
+ * returned and sf_errno is set to ENOMEM.
+ */
+void *sf_calloc(size_t nmemb, size_t size);
+
+/*
+ * Blocks are rounded up to a multiple of 64 bytes, so the payload is usually
+ * larger than requested; all of it may be used.
+ *
+ * @return The number of usable payload bytes in the block at pp, which is at
+ * least the size it was allocated or last reallocated with.  0 if pp is NULL or
+ * not an allocated payload.
+ */
+size_t sf_malloc_usable_size(void *pp);
+
+/*
+ * Allocates like sf_malloc and reports how much was actually handed out, so a
+ * growable container can use the slack before it has to call sf_realloc.
+ *
+ * @param size The minimum payload size.
+ * @param actual If not NULL, receives sf_malloc_usable_size of the result, or 0
+ * if the allocation failed.
+ *
+ * @return As for sf_malloc.
+ */
+void *sf_malloc_at_least(size_t size, size_t *actual);
+
+/*
+ * Grows the heap up front so that bytes more can be allocated in one block
+ * without growing it again, and touches every page of the wilderness so that
+ * none of them faults on first use.
+ *
+ * @param bytes The payload size to make room for.
+ *
+ * @return 0 on success.  If the heap cannot grow that far, -1 is returned and
+ * sf_errno is set to ENOMEM; whatever growth succeeded is kept.
+ */
+int sf_reserve(size_t bytes);
+
+/*
+ * Splits count blocks for requests of size bytes off the heap ahead of time.
+ * Until they run out, sf_malloc requests that round up to the same block size
+ * take one of these blocks without searching, splitting or growing.  Each size
+ * class holds blocks of one size; prefilling a different size in the same class
+ * first frees the blocks set aside for the old one.  Blocks set aside show up
+ * as allocated in sf_show_heap and heap snapshots.  While the sf_free_async
+ * thread runs, it sets aside new blocks as these are handed out, until sf_trim
+ * or memory pressure gives the set back.
+ *
+ * @return The number of blocks set aside, which is less than count if the heap
+ * ran out of memory.  0 if size or count is 0.
+ */
+size_t sf_prefill(size_t size, size_t count);
+
+/*
+ * Memory limits.
+ * Both limits are on the size of the heap, the memory obtained from the page
+ * provider, which only grows.  When the heap first grows past the soft limit the
+ * pressure callbacks run with SF_PRESSURE_SOFT, at the end of the sf_malloc that
+ * grew it (or the next one), so that the application can drop caches.  The heap never grows past the
+ * hard limit: a request that would need it to first gets back the blocks set
+ * aside by sf_prefill and queued by other threads, runs the callbacks with
+ * SF_PRESSURE_HARD and trims, then tries again before failing with ENOMEM.
+ * Callbacks may call sf_malloc and sf_free; they are not run again while one is
+ * running.
+ */
+#define SF_PRESSURE_SOFT 1
+#define SF_PRESSURE_HARD 2
+#define SF_MAX_PRESSURE_CALLBACKS 8
+
+typedef void (*sf_pressure_fn)(int level, size_t heap_size, void *arg);
+
+/*
+ * Sets the soft and hard limits in bytes; 0 for no limit.  The soft limit is
+ * re-armed: if the heap is already past it the callbacks run at the next
+ * sf_malloc.
+ *
+ * @return 0, or -1 with sf_errno set to EINVAL if soft is above a hard limit.
+ */
+int sf_set_limit(size_t soft, size_t hard);
+
+/*
+ * Registers fn to be called with arg when a limit is reached.
+ *
+ * @return 0, or -1 with sf_errno set to EINVAL if fn is NULL or ENOMEM if
+ * SF_MAX_PRESSURE_CALLBACKS are already registered.
+ */
+int sf_add_pressure_callback(sf_pressure_fn fn, void *arg);
+
+/*
+ * Removes a callback registered with the same fn and arg.
+ *
+ * @return 0, or -1 with sf_errno set to EINVAL if there is none.
+ */
+int sf_remove_pressure_callback(sf_pressure_fn fn, void *arg);
+
+/*
+ * Frees the blocks set aside by sf_prefill and any queued by other threads, and
+ * gives the whole pages inside free blocks back to the system.  The heap keeps
+ * its size, but those pages stop counting against the process until they are
+ * used again.  Only page providers that can discard pages give any back (not
+ * sfutil).
+ *
+ * @return The number of bytes given back.  0 if the caller does not own the heap.
+ */
+size_t sf_trim(void);
+
+/*
+ * Real-time mode.
+ * For callers that need a hard bound on how long sf_malloc and sf_free take.
+ * sf_rt_init sets up a heap of a fixed size and touches every page of it up
+ * front, so later calls neither grow the heap nor fault.  From then on:
+ * - the fit search looks at no more than the first SF_RT_SEARCH_DEPTH blocks
+ *   of each free list, so it takes a bounded number of steps;
+ * - a request fails with ENOMEM at once, without growing the heap or calling
+ *   the pressure callbacks, when none of the blocks looked at fits.  That can
+ *   happen while a big enough block sits deeper in a list, so a heap that is
+ *   far from full can still turn a request down; leave headroom;
+ * - sf_realloc only resizes a block where it is.  When the block would have to
+ *   move, it fails with ENOMEM and leaves the block as it was;
+ * - sf_malloc and sf_free do not free the blocks other threads have queued;
+ *   the owner calls sf_heap_drain when it has time;
+ * - no pages are given back, so sf_trim does nothing;
+ * - nothing is sampled into the guarded pool (sfguard.h).  sf_rt_init stops
+ *   sampling, and sf_guard_start fails with EBUSY; guarded blocks allocated
+ *   before can still be freed.
+ * sf_calloc still takes time in proportion to the size it zeroes.  The mode
+ * lasts until the heap is torn down.
+ */
+
+/*
+ * Sets up the heap in real-time mode with room for at least bytes of blocks.
+ * Must be called before anything else allocates.
+ *
+ * @return 0 on success.  -1 with sf_errno set to EBUSY if the heap is already
+ * set up, or ENOMEM if the memory could not be had; the heap may then be set
+ * up in the ordinary mode.
+ */
+int sf_rt_init(size_t bytes);
+
+/* How many blocks of each free list the real-time fit search looks at. */
+#define SF_RT_SEARCH_DEPTH 8
+
+/*
+ * Cross-thread frees.
+ * The heap is owned by the thread that set it up.  sf_free called from any other
+ * thread does not touch the free lists: it pushes the block onto a lock-free
+ * queue, which the owner drains in one batch, coalescing as it goes, at the start
+ * of its next sf_malloc or sf_free.  Only sf_free may be called by non-owners.
+ */
+
+/*
+ * Frees n blocks at once.  The owner frees them all under one drain of the
+ * queue; any other thread links them together and queues the whole chain with
+ * one compare-and-swap.  Each pointer must be one sf_free would accept.
+ */
+void sf_free_batch(void **pps, size_t n);
+
+/*
+ * Makes the calling thread the owner of the heap.  Must not race with
+ * sf_malloc, sf_realloc or sf_memalign in the previous owner.
+ */
+void sf_heap_claim(void);
+
+/*
+ * Frees every block queued by other threads right away.
+ *
+ * @return The number of blocks freed, or 0 if the caller does not own the heap.
+ */
+size_t sf_heap_drain(void);
+
+/*
+ * Asynchronous frees.
+ * sf_free_async hands a block to a maintenance thread instead of freeing it, so
+ * a thread that cannot afford a coalesce never does one.  The maintenance thread
+ * frees what it is handed, together with the blocks other threads queued for the
+ * owner, a batch at a time.  Between batches it tops the sf_prefill blocks back
+ * up and gives the wilderness's pages back to the page provider.  While it runs,
+ * it and the owner take turns at the heap: a call by the owner waits at most for
+ * the block the thread is on.  sf_free keeps working as before from any thread.
+ */
+#define SF_ASYNC_MAX_PENDING 4096   // queue length when sf_free_async_start is given 0
+
+/*
+ * Starts the maintenance thread.  Must be called by the owner.  At most
+ * max_pending blocks (SF_ASYNC_MAX_PENDING if 0) wait in the queue at once; past
+ * that, sf_free_async frees the block itself, like sf_free.
+ *
+ * @return 0 on success.  -1 with sf_errno set to EPERM if the caller does not own
+ * the heap, EBUSY if the thread is already running, or the error from
+ * pthread_create.
+ */
+int sf_free_async_start(size_t max_pending);
+
+/*
+ * Queues the block at pp to be freed by the maintenance thread, from any thread.
+ * pp must be one sf_free would accept.  Without the thread running, or with its
+ * queue full, the block is freed with sf_free instead.
+ */
+void sf_free_async(void *pp);
+
+/*
+ * Stops the maintenance thread and frees whatever is still queued.  Must be
+ * called by the owner, and not race with sf_free_async in other threads.  The
+ * thread must be stopped before the heap is torn down.
+ *
+ * @return 0 on success, or -1 with sf_errno set to EINVAL if the thread is not
+ * running or the caller does not own the heap.
+ */
+int sf_free_async_stop(void);
+
+/* @return How many blocks are waiting for the maintenance thread. */
+size_t sf_free_async_pending(void);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Allocation fast path for sizes known at compile time.
+ * sf_malloc rounds every request up to a block size and works out its size
+ * class at run time.  SF_MALLOC and SF_NEW do both in the preprocessor and the
+ * compiler's constant folding when the size is a constant such as
+ * sizeof(struct node), and go straight to sf_malloc_class.  Any other size
+ * falls through to sf_malloc, so they can be used everywhere.
+ */
+#ifndef SFMM_INLINE_H
+#define SFMM_INLINE_H
+#include <stddef.h>
+#include "sfmm.h"
+
+/* Block size for a payload of n bytes: header included, rounded up to 64, at least 64. */
+#define SF_BLOCK_SIZE(n) ((n) + 8 <= 64 ? (size_t)64 : (size_t)(((n) + 8 + 63) / 64 * 64))
+
+/* Size class (free list) of a block of asize bytes; must match free_list_index in sfmm.c. */
+#define SF_SIZE_CLASS(asize) \
+    ((asize) <= 64 * 1 ? 0 : (asize) <= 64 * 2 ? 1 : (asize) <= 64 * 3 ? 2 : \
+     (asize) <= 64 * 5 ? 3 : (asize) <= 64 * 8 ? 4 : (asize) <= 64 * 13 ? 5 : \
+     (asize) <= 64 * 21 ? 6 : (asize) <= 64 * 34 ? 7 : 8)
+
+/* Constant sizes from 1 up to this take the fast path; 0 and larger ones go to sf_malloc. */
+#define SF_INLINE_MAX (1 << 20)
+
+/*
+ * Allocates like sf_malloc, with the block size and size class already worked
+ * out.  Only meant to be called through the macros below.
+ *
+ * @param asize SF_BLOCK_SIZE of the request.
+ * @param index SF_SIZE_CLASS(asize).
+ */
+void *sf_malloc_class(size_t asize, int index);
+
+/*
+ * sf_malloc(size), with no size arithmetic at run time if size is a
+ * compile-time constant.  size is not evaluated twice.
+ */
+#define SF_MALLOC(size) \
+    (__builtin_constant_p(size) && (size) > 0 && (size) <= SF_INLINE_MAX \
+     ? sf_malloc_class(SF_BLOCK_SIZE(size), SF_SIZE_CLASS(SF_BLOCK_SIZE(size))) \
+     : sf_malloc(size))
+
+/* Allocates one uninitialized object of type T. */
+#define SF_NEW(T) ((T *)SF_MALLOC(sizeof(T)))
+
+#endif
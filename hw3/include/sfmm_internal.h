@@ -0,0 +1,212 @@
+/*
+ * Block-level helpers shared between the sfmm source files.
+ * These are not part of the allocator interface; client code should only use
+ * sfmm.h and the extension headers.
+ */
+#ifndef SFMM_INTERNAL_H
+#define SFMM_INTERNAL_H
+#include <stdint.h>
+#include "sfmm.h"
+
+/*
+ * The heap as seen through the current page provider (sfpage.h).
+ * sfmm code uses these instead of calling sf_mem_grow and friends directly.
+ */
+int sf_heap_init(void);
+void *sf_heap_grow(void);
+void *sf_heap_start(void);
+void *sf_heap_end(void);
+int sf_heap_zeroed(void);
+/*
+ * Drops all allocator state that points into the heap, before a page provider
+ * switch releases it.  @return 0, or -1 with sf_errno set to EBUSY while the
+ * sf_free_async thread runs.
+ */
+int sf_heap_forget(void);
+
+/* @return Nonzero while the heap is in real-time mode (sf_rt_init). */
+int sf_rt_active(void);
+/*
+ * Gives the whole pages inside [start, end) back to the system, if the provider
+ * can.  @return The number of bytes given back.
+ */
+size_t sf_heap_discard(void *start, void *end);
+
+/* Header fields of a block. */
+size_t get_size(sf_block *bp);
+int get_prev_alloc(sf_block *bp);
+int get_alloc(sf_block *bp);
+
+/* Neighbouring addresses: footer of bp, and the blocks after and before it. */
+void *ftrp(sf_block *bp);
+void *next_blockp(sf_block *bp);
+void *prev_blockp(sf_block *bp);
+
+/* Sets up the prologue, the first page and the wilderness block. */
+int sf_init(void);
+
+/* Free list maintenance. */
+int free_list_index(size_t size);
+int is_wilderness(sf_block *p);
+void remove_free_block(sf_block *p);
+void add_free_list(int index, sf_block *p);
+
+/*
+ * Merges the free block p, which must already be on a free list, with its free
+ * neighbours and files the result under the right list.
+ *
+ * @return The start of the merged block.
+ */
+void *coalesce(sf_block *p);
+
+/*
+ * Nonzero (the default) to have find_fit scan the out-of-band free block index,
+ * zero to walk the free lists through the blocks themselves.
+ */
+extern int sf_use_fit_index;
+
+/*
+ * Page map of block starts behind sf_block_of (sfpagemap.c).  Every block
+ * start other than the prologue must be set, and cleared when the block is
+ * merged into the one before it.  Setting an already set start is harmless.
+ */
+void sf_pagemap_reset(void);
+void sf_pagemap_set(sf_block *bp);
+void sf_pagemap_clear(sf_block *bp);
+/* Allocates the map for the whole heap as it stands now.  @return 0, or -1. */
+int sf_pagemap_reserve(void);
+/*
+ * Tag byte kept in the page map for the block starting at bp.  Setting fails,
+ * returning -1, if the map could not be kept; the tag then reads as 0.
+ */
+int sf_pagemap_set_tag(sf_block *bp, int tag);
+int sf_pagemap_tag(sf_block *bp);
+
+/*
+ * Per-tag accounting (sftag.c), done at the public entry points: sf_tag_alloc
+ * when a block is handed to the application, sf_tag_free when it comes back.
+ * sf_tag_free returns the tag the block was counted under.
+ */
+extern __thread int sf_current_tag;
+void sf_tag_alloc(sf_block *bp, int tag);
+int sf_tag_free(sf_block *bp);
+void sf_tag_reset(void);
+
+/* @return Nonzero if pp is the payload of an allocated block. */
+int valid_pointer(void *pp);
+
+/*
+ * Guarded pool (sfguard.c).  SF_GUARD_SAMPLE is true for the allocations
+ * sf_guard_malloc should try to serve; it returns NULL when it will not, and the
+ * heap serves them as usual.  Every path that takes a pointer from the
+ * application checks SF_GUARD_OWNS first and hands those to the sf_guard_*
+ * calls, which only accept pointers for which it is true.  Both are a compare
+ * or two, and always false while sf_guard_start has not been called.
+ */
+extern unsigned sf_guard_rate;
+extern __thread unsigned sf_guard_countdown;
+extern uintptr_t sf_guard_base;
+extern size_t sf_guard_span;
+#define SF_GUARD_SAMPLE() \
+    (__atomic_load_n(&sf_guard_rate, __ATOMIC_RELAXED) != 0 && sf_guard_countdown-- == 0)
+#define SF_GUARD_OWNS(pp) ((uintptr_t)(pp) - sf_guard_base < sf_guard_span)
+void *sf_guard_malloc(size_t size, int tag);
+void sf_guard_free(void *pp);
+/* @return 0, or -1 for the tag, if pp is not a guarded block. */
+size_t sf_guard_usable_size(void *pp);
+int sf_guard_tag(void *pp);
+/* @return The guarded block whose payload contains ptr, or NULL if none does. */
+void *sf_guard_block_of(const void *ptr);
+
+/*
+ * Brackets every public call that reads or changes the heap.  While the
+ * sf_free_async thread runs, they keep it off the heap for the duration (waiting
+ * for it to let go first); otherwise they only count nesting.
+ */
+void sf_heap_enter(void);
+void sf_heap_leave(void);
+
+/*
+ * Latency histogram hooks (see sfhist.h).  Only the outermost public call is
+ * timed; SF_HIST_NOTE marks what happened during it.  All of them compile to
+ * nothing unless SF_HIST is defined.
+ */
+#ifdef SF_HIST
+extern __thread int sf_hist_depth;
+extern __thread int sf_hist_events;
+extern __thread uint64_t sf_hist_start;
+void sf_hist_record(int op, uint64_t cycles, int events);
+
+static inline uint64_t sf_hist_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+#define SF_HIST_ENTER() \
+    do { \
+        if (sf_hist_depth++ == 0) { \
+            sf_hist_events = 0; \
+            sf_hist_start = sf_hist_cycles(); \
+        } \
+    } while (0)
+#define SF_HIST_LEAVE(op) \
+    do { \
+        if (--sf_hist_depth == 0) { \
+            sf_hist_record(op, sf_hist_cycles() - sf_hist_start, sf_hist_events); \
+        } \
+    } while (0)
+#define SF_HIST_NOTE(ev) (sf_hist_events |= (ev))
+#else
+#define SF_HIST_ENTER()
+#define SF_HIST_LEAVE(op)
+#define SF_HIST_NOTE(ev)
+#endif
+
+/*
+ * Performance counter probes (see sfperf.h), placed just inside the SF_HIST ones.
+ * They only read the counters in a thread that has opened them, and compile to
+ * nothing unless SF_PERF is defined.
+ */
+#ifdef SF_PERF
+extern __thread int sf_perf_fd;
+extern __thread int sf_perf_depth;
+void sf_perf_begin(void);
+void sf_perf_end(int op);
+#define SF_PERF_ENTER() \
+    do { \
+        if (sf_perf_fd >= 0 && sf_perf_depth++ == 0) { \
+            sf_perf_begin(); \
+        } \
+    } while (0)
+#define SF_PERF_LEAVE(op) \
+    do { \
+        if (sf_perf_fd >= 0 && --sf_perf_depth == 0) { \
+            sf_perf_end(op); \
+        } \
+    } while (0)
+#else
+#define SF_PERF_ENTER()
+#define SF_PERF_LEAVE(op)
+#endif
+
+/*
+ * Event tracing hook (see sftrace.h), called by the public entry points once
+ * they know the result.  Compiles to nothing unless SF_TRACE is defined.
+ */
+#ifdef SF_TRACE
+extern int sf_trace_on;
+void sf_trace_record(int op, size_t size, size_t align, void *ptr, void *old);
+#define SF_TRACE_EVENT(op, size, align, ptr, old) \
+    do { \
+        if (__atomic_load_n(&sf_trace_on, __ATOMIC_RELAXED)) { \
+            sf_trace_record(op, size, align, ptr, old); \
+        } \
+    } while (0)
+#else
+#define SF_TRACE_EVENT(op, size, align, ptr, old)
+#endif
+
+#endif
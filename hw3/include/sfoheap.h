@@ -0,0 +1,79 @@
+/*
+ * Position-independent heaps.
+ * An sf_oheap is a heap laid out in one contiguous mapping that may be mapped at a
+ * different address each time: blocks use the sfmm boundary-tag format, but free
+ * list links and the root are stored as byte offsets from the start of the mapping.
+ * The mapping starts with the sf_oheap header; the heap proper (padding, prologue,
+ * blocks, epilogue) starts at SF_OHEAP_START and runs to the end of the mapping.
+ *
+ * These are the building blocks of the persistent heap (sfpersist.h); they do no
+ * locking and no I/O of their own.
+ */
+#ifndef SFOHEAP_H
+#define SFOHEAP_H
+#include <stddef.h>
+#include <stdint.h>
+#include "sfmm.h"
+
+#define SF_OHEAP_MAGIC 0x3150414548465300ull   // "\0SFHEAP1" read as little-endian bytes
+#define SF_OHEAP_VERSION 1
+
+/* Offset of the heap proper from the start of the mapping. */
+#define SF_OHEAP_START 512
+/* The smallest mapping that holds a header, an empty heap and one minimum-size block. */
+#define SF_OHEAP_MIN_SIZE (SF_OHEAP_START + 48 + 64 + 64 + 16)
+
+typedef struct sf_oheap {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t dirty;                     // nonzero while the heap may be mid-update
+    uint64_t size;                      // of the whole mapping
+    uint64_t root;                      // offset of the root payload, 0 if none
+    uint64_t heads[NUM_FREE_LISTS];     // offset of the first block on each list, 0 if empty
+} sf_oheap;
+
+/*
+ * Lays out an empty heap covering size bytes at h: one free block between the
+ * prologue and the epilogue, and no root.
+ *
+ * @param size The size of the mapping; a multiple of 64 of at least SF_OHEAP_MIN_SIZE.
+ * @param dirty The dirty mark the heap is published with.  It is written before
+ * the magic number, so a heap that shows up as formatted already carries it.
+ *
+ * @return 0 on success, or -1 if size is unusable.
+ */
+int sf_oheap_format(sf_oheap *h, size_t size, int dirty);
+
+/*
+ * @return Nonzero if h looks like a heap of this version that fills exactly size bytes.
+ */
+int sf_oheap_valid(sf_oheap *h, size_t size);
+
+/*
+ * Rebuilds the heap metadata from the block headers alone: walks the blocks from
+ * the prologue to the epilogue, merges neighbouring free blocks, rewrites the
+ * footers and prev-alloc bits, and threads fresh free lists.
+ *
+ * @return 0 on success, or -1 if the headers do not chain up to the epilogue.
+ */
+int sf_oheap_rebuild(sf_oheap *h);
+
+/*
+ * Allocates from h, exactly like sf_malloc.
+ *
+ * @return The payload, or NULL with sf_errno set to ENOMEM if nothing fits.
+ * If size is 0, NULL is returned without setting sf_errno.
+ */
+void *sf_oheap_malloc(sf_oheap *h, size_t size);
+
+/*
+ * Frees a payload returned by sf_oheap_malloc on the same heap.
+ * Calls abort() if pp is not an allocated payload of h.
+ */
+void sf_oheap_free(sf_oheap *h, void *pp);
+
+/* Converts between payload addresses and offsets from the start of the mapping. */
+uint64_t sf_oheap_offset(sf_oheap *h, void *pp);
+void *sf_oheap_at(sf_oheap *h, uint64_t offset);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Page providers.
+ * All heap memory comes from a page provider, which hands sfmm one PAGE_SZ page
+ * at a time at the end of a contiguous region.  The default provider is sfutil's
+ * sf_mem_grow; the others reserve address space with mmap and commit it as the
+ * heap grows, optionally backed by huge pages.
+ */
+#ifndef SFPAGE_H
+#define SFPAGE_H
+#include <stddef.h>
+
+typedef struct sf_page_provider {
+    const char *name;
+    /* Sets up an empty heap, throwing away any previous one.  @return 0, or -1 on failure. */
+    int (*init)(size_t reserve);
+    /* Releases the heap. */
+    void (*fini)(void);
+    /* Adds one PAGE_SZ page at the end.  @return Its address, or NULL with sf_errno set to ENOMEM. */
+    void *(*grow)(void);
+    void *(*start)(void);
+    void *(*end)(void);
+    /* Nonzero if pages handed over by grow are zero-filled. */
+    int zeroed;
+    /*
+     * Optional.  Gives the memory behind [start, start + len), whole pages inside
+     * the heap, back to the system; it must still read as zeros or as its old
+     * contents afterwards.  NULL if the provider cannot do this.
+     * @return The bytes actually given back, 0 if the system refused.
+     */
+    size_t (*discard)(void *start, size_t len);
+} sf_page_provider;
+
+/* sf_mem_init/sf_mem_grow from sfutil: a fixed pre-reserved region. */
+extern const sf_page_provider sf_sfutil_pages;
+/* An mmap-reserved region, committed one page at a time. */
+extern const sf_page_provider sf_mmap_pages;
+/*
+ * A 2 MiB-aligned region backed by MAP_HUGETLB pages.  hugetlb pages cannot be
+ * committed piecemeal, so the whole reservation is mapped when the heap is set
+ * up and takes reserve / 2 MiB pages out of the system's huge page pool at once
+ * (128 of them for SF_DEFAULT_RESERVE), however little the heap uses; pass a
+ * reserve sized to the heap.  Pages are only given back a whole huge page at a
+ * time.  If the pool cannot cover the reservation, an ordinary mapping is used,
+ * committed in 2 MiB steps, and the kernel is asked to back it with transparent
+ * huge pages instead.
+ */
+extern const sf_page_provider sf_hugepage_pages;
+
+/* Address space reserved by the mmap providers when no size is given. */
+#define SF_DEFAULT_RESERVE (256UL << 20)
+
+/*
+ * Selects where heap pages come from.  Any heap built by the previous provider
+ * is released along with every block in it, even when switching back to the
+ * same provider; the next allocation sets up a fresh heap with the new one.
+ * Fails while sf_free_async_start's thread runs, since it may still hold blocks.
+ *
+ * @param provider One of the providers above, or a custom one.
+ * @param reserve The most bytes the heap may grow to, for providers that reserve
+ * address space up front.  0 selects SF_DEFAULT_RESERVE.
+ *
+ * @return 0 on success.  If provider is NULL, -1 is returned and sf_errno is set to
+ * EINVAL; if the sf_free_async thread runs, to EBUSY.
+ */
+int sf_set_page_provider(const sf_page_provider *provider, size_t reserve);
+
+/*
+ * @return The provider currently in use.
+ */
+const sf_page_provider *sf_get_page_provider(void);
+
+/*
+ * @return What backs the current heap: "sfutil", "mmap", "hugetlb" or "thp"
+ * (transparent huge pages), or the provider's name for a custom provider.
+ */
+const char *sf_page_backing(void);
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Pointer-to-block lookups.
+ * sfmm keeps a radix page map of the heap: for every heap page, which of its
+ * 64-byte granules start a block payload.  It is updated as blocks are split,
+ * coalesced and added by heap growth, so these lookups never walk the heap.
+ */
+#ifndef SFPAGEMAP_H
+#define SFPAGEMAP_H
+
+/*
+ * @return Nonzero if ptr points anywhere inside the payload of an allocated
+ * sfmm block, whether it is in the heap or in the guarded pool (sfguard.h).
+ */
+int sf_owns(const void *ptr);
+
+/*
+ * Finds the block an interior pointer belongs to.
+ *
+ * @return The start of the payload of the allocated block whose payload
+ * contains ptr, or NULL if ptr is outside the heap and the guarded pool, in a
+ * free block, or in a block header.  For a guarded block the payload runs to
+ * its size rounded up to a multiple of 64.
+ */
+void *sf_block_of(const void *ptr);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Hardware performance counters per operation.
+ * When the allocator is built with SF_PERF defined (make perf), every call to
+ * sf_malloc, sf_free, sf_realloc and sf_memalign made by a thread that has called
+ * sf_perf_open adds what the counters below moved by during the call to that
+ * operation's totals.  The counters are opened with perf_event_open(2) for the
+ * calling thread only and count user space only, so they need no privileges
+ * beyond a perf_event_paranoid of 2 or less.  Counters the CPU, kernel or
+ * hypervisor does not provide are left out; the others still count.
+ *
+ * Each call reads the counters with a system call on the way in and out, so
+ * times taken with SF_PERF are not comparable with those of other builds.
+ *
+ * Intended for the benchmarks: reset, run one workload, dump.
+ */
+#ifndef SFPERF_H
+#define SFPERF_H
+#include <stdint.h>
+#include <stdio.h>
+#include "sfhist.h"
+
+#define SF_PERF_CYCLES          0
+#define SF_PERF_INSTRUCTIONS    1
+#define SF_PERF_L1D_MISSES      2   // L1 data cache read misses
+#define SF_PERF_LLC_MISSES      3   // last level cache misses
+#define SF_PERF_DTLB_MISSES     4   // data TLB read misses
+#define SF_PERF_BRANCH_MISSES   5
+#define SF_PERF_PAGE_FAULTS     6   // a software counter, so usually there even in a VM
+#define SF_PERF_NUM_COUNTERS    7
+
+typedef struct sf_perf_counts {
+    uint64_t calls;
+    uint64_t values[SF_PERF_NUM_COUNTERS];  // SF_PERF_* totals over all calls
+} sf_perf_counts;
+
+/*
+ * Opens the counters for the calling thread and starts counting its calls.
+ * Only one thread should have them open at a time.
+ *
+ * @return A mask with bit SF_PERF_* set for every counter that is counting.  -1
+ * with sf_errno set to ENOTSUP if the allocator was built without SF_PERF,
+ * EBUSY if the counters are already open, or the errno of the first counter
+ * if none of them could be opened.
+ */
+int sf_perf_open(void);
+
+/*
+ * Closes the calling thread's counters.  The totals are kept.
+ */
+void sf_perf_close(void);
+
+/*
+ * @return The totals for one of the SF_OP_* operations, or NULL if op is out of
+ * range.  These include the cost of reading the counters, which sf_perf_dump
+ * takes out again.
+ */
+const sf_perf_counts *sf_perf_get(int op);
+
+/*
+ * Clears every total.
+ */
+void sf_perf_reset(void);
+
+/*
+ * Writes the mean of every counter per call of each operation that has calls to
+ * out as a table headed by title, less the cost of reading the counters as
+ * measured by sf_perf_open.  Writes nothing if no calls were counted.
+ */
+void sf_perf_dump(FILE *out, const char *title);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Persistent heaps.
+ * A persistent heap lives in a memory-mapped file and survives the process: it
+ * can be closed and reopened later, by this or another process, possibly at a
+ * different address.  Blocks have the sfmm layout; free lists and the root are
+ * kept as offsets from the start of the file (see sfoheap.h), so nothing has to
+ * be rebuilt or relocated on reopen.  Objects that refer to each other should
+ * store offsets too (sf_pheap_offset and sf_pheap_at).
+ *
+ * Crash consistency: while a heap is open its file is marked dirty.  Every
+ * update keeps the chain of block headers intact, so if the process dies
+ * without calling sf_pheap_close, the next sf_pheap_open walks the headers and
+ * rebuilds the free lists, footers and prev-alloc bits from them.  A block that
+ * was allocated but not yet made reachable from the root at the time of the
+ * crash stays allocated.  After a system crash, only what reached the disk can
+ * be recovered; call sf_pheap_sync after updates that must survive one.
+ * Only one process may have a given file open at a time.
+ */
+#ifndef SFPERSIST_H
+#define SFPERSIST_H
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct sf_pheap sf_pheap;
+
+/*
+ * Opens the persistent heap in the file at path.  If the file is missing or
+ * empty, it is created with an empty heap of size bytes (rounded up to PAGE_SZ).
+ * Otherwise size is ignored and the existing heap is mapped; if it was not
+ * closed cleanly, its metadata is rebuilt first.
+ *
+ * @return The heap, or NULL with sf_errno set: EINVAL if the file is not a
+ * heap, is damaged beyond repair, or is new and size is too small (or above
+ * 4 GiB); EBUSY if another process has it open; otherwise the errno of the
+ * failed system call.
+ */
+sf_pheap *sf_pheap_open(const char *path, size_t size);
+
+/*
+ * Flushes the heap to its file, marks it clean and unmaps it.
+ *
+ * @return 0 on success, or -1 with sf_errno set if the flush failed.  The heap
+ * is closed either way.
+ */
+int sf_pheap_close(sf_pheap *heap);
+
+/*
+ * Writes every modified page of the heap back to its file and waits for it.
+ *
+ * @return 0 on success, or -1 with sf_errno set.
+ */
+int sf_pheap_sync(sf_pheap *heap);
+
+/*
+ * @return Nonzero if sf_pheap_open had to rebuild the heap after a crash.
+ */
+int sf_pheap_recovered(sf_pheap *heap);
+
+/*
+ * Allocates from the heap, like sf_malloc.
+ *
+ * @return The payload, or NULL with sf_errno set to ENOMEM.  If size is 0, NULL
+ * is returned without setting sf_errno.
+ */
+void *sf_pheap_malloc(sf_pheap *heap, size_t size);
+
+/*
+ * Frees a payload allocated from the heap.  Calls abort() if pp is not one.
+ * Freeing the root clears it.
+ */
+void sf_pheap_free(sf_pheap *heap, void *pp);
+
+/*
+ * The root is the one object a reopened heap can be found by.
+ *
+ * @return The root payload, or NULL if none has been set.
+ */
+void *sf_pheap_root(sf_pheap *heap);
+
+/*
+ * Makes pp, a payload allocated from the heap or NULL, the root.
+ */
+void sf_pheap_set_root(sf_pheap *heap, void *pp);
+
+/*
+ * @return The offset of pp from the start of the heap, or 0 for NULL.
+ */
+uint64_t sf_pheap_offset(sf_pheap *heap, void *pp);
+
+/*
+ * @return The address of the offset returned by sf_pheap_offset in the current
+ * mapping, or NULL for 0.
+ */
+void *sf_pheap_at(sf_pheap *heap, uint64_t offset);
+
+#endif
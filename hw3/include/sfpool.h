@@ -0,0 +1,44 @@
+/*
+ * Fixed-size object pools.
+ * A pool packs objects of one size densely into page-sized blocks taken from
+ * the sfmm heap.  Free objects are threaded on an intrusive list, so objects
+ * carry no header of their own and allocation never searches the free lists.
+ */
+#ifndef SFPOOL_H
+#define SFPOOL_H
+#include <stddef.h>
+
+typedef struct sf_pool sf_pool;
+
+/*
+ * Creates an empty pool.
+ *
+ * @param obj_size The size of each object in bytes.
+ * @param align The alignment required of each object.  0 selects 16 bytes.
+ *
+ * @return If obj_size is 0, or align is not a power of two or is larger than the
+ * 64-byte payload alignment of the heap, then NULL is returned and sf_errno is set
+ * to EINVAL.  If memory for the pool cannot be obtained, then NULL is returned and
+ * sf_errno is set to ENOMEM.
+ */
+sf_pool *sf_pool_create(size_t obj_size, size_t align);
+
+/*
+ * Takes one object from a pool, growing it by a page if it is empty.
+ *
+ * @return A pointer to the object, or NULL with sf_errno set to ENOMEM.
+ */
+void *sf_pool_alloc(sf_pool *pool);
+
+/*
+ * Returns an object to the pool it came from.  If obj is NULL nothing happens.
+ */
+void sf_pool_free(sf_pool *pool, void *obj);
+
+/*
+ * Returns every page of a pool, and the pool itself, to the sfmm heap.
+ * Objects still in use become invalid.
+ */
+void sf_pool_destroy(sf_pool *pool);
+
+#endif
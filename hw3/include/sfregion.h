@@ -0,0 +1,59 @@
+/*
+ * Regions: bump-pointer arenas for memory that all dies at the same time.
+ * A region takes chunks from the sfmm heap with sf_malloc and serves requests
+ * out of them by bumping a pointer.  Nothing is freed individually; everything
+ * is released at once by sf_region_reset or sf_region_destroy.
+ */
+#ifndef SFREGION_H
+#define SFREGION_H
+#include <stddef.h>
+
+typedef struct sf_region sf_region;
+
+typedef struct sf_region_stats {
+    size_t chunks;          // chunks currently owned by the region
+    size_t capacity;        // usable bytes in those chunks
+    size_t used;            // bytes handed out since the last reset, including alignment padding
+    size_t high_water;      // largest value of used seen since the region was created
+    size_t resets;          // number of calls to sf_region_reset
+} sf_region_stats;
+
+/*
+ * Creates an empty region.
+ *
+ * @param chunk_size The number of usable bytes to request from sf_malloc for each chunk.
+ * If 0, chunks are sized so that each one fills a page.
+ *
+ * @return The new region, or NULL with sf_errno set to ENOMEM.
+ */
+sf_region *sf_region_create(size_t chunk_size);
+
+/*
+ * Allocates size bytes from a region.  Requests larger than the chunk size get
+ * a chunk of their own.
+ *
+ * @param align The alignment required of the returned pointer.  0 selects 16 bytes.
+ *
+ * @return If align is not a power of two, then NULL is returned and sf_errno is set to EINVAL.
+ * If size is 0, then NULL is returned without setting sf_errno.
+ * If no chunk can be obtained, then NULL is returned and sf_errno is set to ENOMEM.
+ */
+void *sf_region_alloc(sf_region *r, size_t size, size_t align);
+
+/*
+ * Releases everything allocated from a region in O(1).  The chunks are kept
+ * and refilled by later allocations.
+ */
+void sf_region_reset(sf_region *r);
+
+/*
+ * Returns every chunk, and the region itself, to the sfmm heap.
+ */
+void sf_region_destroy(sf_region *r);
+
+/*
+ * Fills in the statistics of a region.
+ */
+void sf_region_get_stats(sf_region *r, sf_region_stats *stats);
+
+#endif
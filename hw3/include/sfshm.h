@@ -0,0 +1,90 @@
+/*
+ * Shared-memory heaps.
+ * A shared-memory heap lives in a named POSIX shared-memory segment that any
+ * number of processes can attach, each at whatever address the kernel picks.
+ * Blocks have the sfmm layout and free lists are linked by offsets (see
+ * sfoheap.h), so a block allocated in one process can be handed to another as
+ * an offset and freed there.  Allocation and freeing are serialized by a
+ * process-shared mutex kept in the segment.
+ *
+ * If a process dies while holding that mutex, the next process to take it
+ * rebuilds the free lists from the block headers before going on.
+ */
+#ifndef SFSHM_H
+#define SFSHM_H
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct sf_shm sf_shm;
+
+/*
+ * Creates a segment called name (as for shm_open, e.g. "/queue") holding an
+ * empty heap of size bytes, rounded up to PAGE_SZ, and attaches it.
+ *
+ * @return The heap, or NULL with sf_errno set: EEXIST if the segment already
+ * exists, EINVAL if size is too small or above 4 GiB, otherwise the errno of
+ * the failed system call.
+ */
+sf_shm *sf_shm_create(const char *name, size_t size);
+
+/*
+ * Attaches the heap in an existing segment.
+ *
+ * @return The heap, or NULL with sf_errno set: ENOENT if there is no such
+ * segment, EAGAIN if its creator has not finished setting it up, EINVAL if it
+ * does not hold a heap.
+ */
+sf_shm *sf_shm_attach(const char *name);
+
+/*
+ * Unmaps the heap from this process.  Blocks stay allocated.
+ */
+void sf_shm_detach(sf_shm *shm);
+
+/*
+ * Removes the segment name.  Processes that have it attached keep using it;
+ * the memory goes away when the last one detaches.
+ *
+ * @return 0 on success, or -1 with sf_errno set.
+ */
+int sf_shm_unlink(const char *name);
+
+/*
+ * Allocates from the heap, like sf_malloc.
+ *
+ * @return The payload, or NULL with sf_errno set to ENOMEM.  If size is 0, NULL
+ * is returned without setting sf_errno.  If a crashed process left the heap
+ * damaged beyond repair, NULL is returned with sf_errno set to ENOTRECOVERABLE.
+ */
+void *sf_shm_malloc(sf_shm *shm, size_t size);
+
+/*
+ * Frees a payload allocated from the heap by any process.  Calls abort() if pp
+ * is not one.
+ */
+void sf_shm_free(sf_shm *shm, void *pp);
+
+/*
+ * A root object that every process can find, e.g. a queue of message offsets.
+ *
+ * @return The root payload in this process's mapping, or NULL if none is set.
+ */
+void *sf_shm_root(sf_shm *shm);
+
+/*
+ * Makes pp, a payload allocated from the heap or NULL, the root.
+ */
+void sf_shm_set_root(sf_shm *shm, void *pp);
+
+/*
+ * @return The offset of pp from the start of the segment, or 0 for NULL.
+ * Offsets are what processes pass each other.
+ */
+uint64_t sf_shm_offset(sf_shm *shm, void *pp);
+
+/*
+ * @return The address of offset in this process's mapping, or NULL for 0.
+ */
+void *sf_shm_at(sf_shm *shm, uint64_t offset);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Compact binary heap snapshots.
+ * A snapshot is an sf_snap_header followed by one sf_snap_record per block, in
+ * address order from the first block after the prologue up to the epilogue.
+ * All fields are written in host byte order.
+ */
+#ifndef SFSNAP_H
+#define SFSNAP_H
+#include <stdint.h>
+
+#define SF_SNAP_MAGIC 0x50414e53u     // "SNAP" read as little-endian bytes
+#define SF_SNAP_VERSION 1
+
+#define SF_SNAP_ALLOC       0x1     // same bit as THIS_BLOCK_ALLOCATED
+#define SF_SNAP_PREV_ALLOC  0x2     // same bit as PREV_BLOCK_ALLOCATED
+#define SF_SNAP_NO_LIST     (-1)    // list field of an allocated block
+
+typedef struct sf_snap_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_lists;         // NUM_FREE_LISTS of the writer
+    uint64_t heap_start;        // address of the heap in the writing process
+    uint64_t heap_size;         // sf_mem_end() - sf_mem_start()
+    uint64_t num_records;
+} sf_snap_header;
+
+typedef struct sf_snap_record {
+    uint64_t offset;            // of the block from the heap start
+    uint32_t size;
+    uint8_t flags;              // SF_SNAP_ALLOC | SF_SNAP_PREV_ALLOC
+    int8_t list;                // free list the block belongs on, or SF_SNAP_NO_LIST
+    uint16_t reserved;
+} sf_snap_record;
+
+/*
+ * Writes a snapshot of the sfmm heap to a file descriptor.
+ * Unlike sf_show_heap, nothing is formatted: records are buffered and written
+ * with a few large write() calls.
+ *
+ * @return 0 on success.  If a write fails, -1 is returned and sf_errno is set to
+ * the errno of the failed write.
+ */
+int sf_heap_snapshot(int fd);
+
+#endif
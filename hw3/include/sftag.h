@@ -0,0 +1,54 @@
+/*
+ * Allocation tags for per-subsystem accounting.
+ * Every block handed out by sf_malloc, sf_calloc, sf_realloc and sf_memalign is
+ * counted under a tag from 0 to SF_MAX_TAGS - 1: the calling thread's current
+ * tag, or the one given to sf_malloc_tagged.  sf_realloc keeps the tag of the
+ * block it is given.  The tag is kept in the heap's page map (sfpagemap.h), so
+ * blocks are no larger for it.  Counts are in block bytes, header and rounding
+ * included, and are reset when the heap is set up.
+ */
+#ifndef SFTAG_H
+#define SFTAG_H
+#include <stddef.h>
+
+#define SF_MAX_TAGS 256
+#define SF_TAG_NONE 0       // the current tag of every thread to begin with
+
+/*
+ * Allocates like sf_malloc, counting the block under tag.
+ *
+ * @return As for sf_malloc.  If tag is out of range, NULL is returned and
+ * sf_errno is set to EINVAL.
+ */
+void *sf_malloc_tagged(size_t size, int tag);
+
+/*
+ * Sets the calling thread's current tag.  To scope it, put back the previous
+ * tag when done:
+ *
+ *     int saved = sf_tag_set(PARSER_TAG);
+ *     ...
+ *     sf_tag_set(saved);
+ *
+ * @return The previous tag, or -1 with sf_errno set to EINVAL if tag is out of
+ * range.
+ */
+int sf_tag_set(int tag);
+
+/* @return The calling thread's current tag. */
+int sf_tag_get(void);
+
+/*
+ * @return The tag the allocated block at pp is counted under, or -1 if pp is not
+ * an allocated payload.
+ */
+int sf_tag_of(void *pp);
+
+/*
+ * @return The bytes in blocks currently allocated under tag, and the most there
+ * have been at once.  0 if tag is out of range.
+ */
+size_t sf_tag_live(int tag);
+size_t sf_tag_peak(int tag);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Allocation event tracing.
+ * When the allocator is built with SF_TRACE defined (make trace), every call to
+ * sf_malloc, sf_free, sf_realloc and sf_memalign between sf_trace_start and
+ * sf_trace_stop is recorded as one fixed-size sf_trace_event.  The calling thread
+ * only stores the event into its own lock-free ring buffer; a background thread
+ * writes the rings out to the trace file.  If a ring fills up faster than it is
+ * written out, events are dropped and counted rather than waited for.
+ *
+ * A trace file is an sf_trace_header followed by num_events events, in host byte
+ * order.  Events of one thread are in the order they happened; events of
+ * different threads are interleaved in chunks and have to be sorted by time (the
+ * replay tool, sftrace, does this).
+ */
+#ifndef SFTRACE_H
+#define SFTRACE_H
+#include <stdint.h>
+
+#define SF_TRACE_MAGIC 0x52544653u    // "SFTR" read as little-endian bytes
+#define SF_TRACE_VERSION 1
+
+#define SF_TRACE_CLOCK_TSC 0    // CPU timestamp counter cycles
+#define SF_TRACE_CLOCK_NS  1    // CLOCK_MONOTONIC nanoseconds
+
+typedef struct sf_trace_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;        // sizeof(sf_trace_event) of the writer
+    uint32_t clock;             // SF_TRACE_CLOCK_*
+    uint32_t reserved;
+    uint64_t heap_start;        // address of the heap in the traced process
+    uint64_t num_events;
+    uint64_t dropped;
+} sf_trace_header;
+
+typedef struct sf_trace_event {
+    uint64_t time;
+    uint64_t size;              // bytes requested
+    uint64_t ptr;               // pointer returned, or freed by sf_free
+    uint64_t old;               // pointer passed to sf_realloc
+    uint32_t align;             // alignment passed to sf_memalign
+    uint16_t thread;            // which thread's ring the event came through
+    uint8_t op;                 // SF_OP_* (sfhist.h)
+    uint8_t reserved;
+} sf_trace_event;
+
+/*
+ * Starts recording to a new file at path, truncating it if it exists.
+ *
+ * @return 0 on success.  -1 with sf_errno set to ENOTSUP if the allocator was
+ * built without SF_TRACE, EBUSY if a trace is already running, or the errno of
+ * the failed open or thread creation.
+ */
+int sf_trace_start(const char *path);
+
+/*
+ * Stops recording, writes out every event still in the rings and completes the
+ * header.  Calls still running in other threads when it is called may be missed.
+ *
+ * @return 0 on success.  -1 with sf_errno set to EINVAL if no trace is running,
+ * or to the errno of a failed write; the trace is stopped either way.
+ */
+int sf_trace_stop(void);
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * SIMD copy and zero kernels with streaming stores for large sizes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "debug.h"
+#include "sfcopy.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SF_X86 1
+#endif
+
+size_t sf_copy_nt_threshold = 1 << 20;
+
+typedef struct copy_kernels {
+    void (*copy)(void *dst, const void *src, size_t n);
+    void (*zero)(void *dst, size_t n);
+} copy_kernels;
+
+static const char *isa_names[SF_NUM_ISAS] = { "generic", "sse2", "avx2", "avx512" };
+
+static void copy_generic(void *dst, const void *src, size_t n) {
+    memmove(dst, src, n);
+}
+
+static void zero_generic(void *dst, size_t n) {
+    memset(dst, 0, n);
+}
+
+/*
+ * Below the threshold every kernel hands off to libc, which already picks a
+ * vector path for cached copies; the kernels here only add the streaming path.
+ * So does anything shorter than one round, which also keeps the head inside n
+ * however low the threshold is set.
+ * They copy in rounds of four vectors, loading all four before storing any, so a
+ * forward copy onto a lower, overlapping range never reads bytes it has already
+ * overwritten.  Streaming stores need an aligned destination, so the bytes up to
+ * the first boundary, and the tail, go through memmove.
+ */
+
+#ifdef SF_X86
+
+__attribute__((target("sse2")))
+static void copy_sse2(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < sf_copy_nt_threshold || n < 64) {
+        memmove(d, s, n);
+        return;
+    }
+    size_t head = (-(uintptr_t)d) & 15;
+    memmove(d, s, head);
+    d += head; s += head; n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s);
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, a);
+        _mm_stream_si128((__m128i *)(d + 16), b);
+        _mm_stream_si128((__m128i *)(d + 32), c);
+        _mm_stream_si128((__m128i *)(d + 48), e);
+    }
+    _mm_sfence();
+    memmove(d, s, n);
+}
+
+__attribute__((target("sse2")))
+static void zero_sse2(void *dst, size_t n) {
+    char *d = dst;
+    if (n < sf_copy_nt_threshold || n < 64) {
+        memset(d, 0, n);
+        return;
+    }
+    __m128i z = _mm_setzero_si128();
+    size_t head = (-(uintptr_t)d) & 15;
+    memset(d, 0, head);
+    d += head; n -= head;
+    for (; n >= 64; n -= 64, d += 64) {
+        _mm_stream_si128((__m128i *)d, z);
+        _mm_stream_si128((__m128i *)(d + 16), z);
+        _mm_stream_si128((__m128i *)(d + 32), z);
+        _mm_stream_si128((__m128i *)(d + 48), z);
+    }
+    _mm_sfence();
+    memset(d, 0, n);
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < sf_copy_nt_threshold || n < 128) {
+        memmove(d, s, n);
+        return;
+    }
+    size_t head = (-(uintptr_t)d) & 31;
+    memmove(d, s, head);
+    d += head; s += head; n -= head;
+    for (; n >= 128; n -= 128, d += 128, s += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_stream_si256((__m256i *)d, a);
+        _mm256_stream_si256((__m256i *)(d + 32), b);
+        _mm256_stream_si256((__m256i *)(d + 64), c);
+        _mm256_stream_si256((__m256i *)(d + 96), e);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memmove(d, s, n);
+}
+
+__attribute__((target("avx2")))
+static void zero_avx2(void *dst, size_t n) {
+    char *d = dst;
+    if (n < sf_copy_nt_threshold || n < 128) {
+        memset(d, 0, n);
+        return;
+    }
+    __m256i z = _mm256_setzero_si256();
+    size_t head = (-(uintptr_t)d) & 31;
+    memset(d, 0, head);
+    d += head; n -= head;
+    for (; n >= 128; n -= 128, d += 128) {
+        _mm256_stream_si256((__m256i *)d, z);
+        _mm256_stream_si256((__m256i *)(d + 32), z);
+        _mm256_stream_si256((__m256i *)(d + 64), z);
+        _mm256_stream_si256((__m256i *)(d + 96), z);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memset(d, 0, n);
+}
+
+__attribute__((target("avx512f")))
+static void copy_avx512(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < sf_copy_nt_threshold || n < 256) {
+        memmove(d, s, n);
+        return;
+    }
+    size_t head = (-(uintptr_t)d) & 63;
+    memmove(d, s, head);
+    d += head; s += head; n -= head;
+    for (; n >= 256; n -= 256, d += 256, s += 256) {
+        __m512i a = _mm512_loadu_si512((const void *)s);
+        __m512i b = _mm512_loadu_si512((const void *)(s + 64));
+        __m512i c = _mm512_loadu_si512((const void *)(s + 128));
+        __m512i e = _mm512_loadu_si512((const void *)(s + 192));
+        _mm512_stream_si512((void *)d, a);
+        _mm512_stream_si512((void *)(d + 64), b);
+        _mm512_stream_si512((void *)(d + 128), c);
+        _mm512_stream_si512((void *)(d + 192), e);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memmove(d, s, n);
+}
+
+__attribute__((target("avx512f")))
+static void zero_avx512(void *dst, size_t n) {
+    char *d = dst;
+    if (n < sf_copy_nt_threshold || n < 256) {
+        memset(d, 0, n);
+        return;
+    }
+    __m512i z = _mm512_setzero_si512();
+    size_t head = (-(uintptr_t)d) & 63;
+    memset(d, 0, head);
+    d += head; n -= head;
+    for (; n >= 256; n -= 256, d += 256) {
+        _mm512_stream_si512((void *)d, z);
+        _mm512_stream_si512((void *)(d + 64), z);
+        _mm512_stream_si512((void *)(d + 128), z);
+        _mm512_stream_si512((void *)(d + 192), z);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memset(d, 0, n);
+}
+
+#endif
+
+static const copy_kernels kernels[SF_NUM_ISAS] = {
+    { copy_generic, zero_generic },
+#ifdef SF_X86
+    { copy_sse2, zero_sse2 },
+    { copy_avx2, zero_avx2 },
+    { copy_avx512, zero_avx512 },
+#endif
+};
+
+static int supported(int isa) {
+    switch (isa) {
+    case SF_ISA_GENERIC:
+        return 1;
+#ifdef SF_X86
+    case SF_ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SF_ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SF_ISA_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return 0;
+    }
+}
+
+static int current_isa = -1; // -1 until the first call picks one
+
+static int best_isa(void) {
+    int isa;
+    for (isa = SF_NUM_ISAS - 1; isa > SF_ISA_GENERIC; isa--) {
+        if (supported(isa)) {
+            return isa;
+        }
+    }
+    return SF_ISA_GENERIC;
+}
+
+static const copy_kernels *active(void) {
+    int isa = __atomic_load_n(&current_isa, __ATOMIC_RELAXED);
+    if (isa < 0) {
+        isa = best_isa();
+        __atomic_store_n(&current_isa, isa, __ATOMIC_RELAXED);
+    }
+    return &kernels[isa];
+}
+
+void sf_copy(void *dst, const void *src, size_t n) {
+    active()->copy(dst, src, n);
+}
+
+void sf_zero(void *dst, size_t n) {
+    active()->zero(dst, n);
+}
+
+int sf_copy_select(int isa) {
+    if (isa == -1) {
+        isa = best_isa();
+    }
+    if (isa < 0 || isa >= SF_NUM_ISAS || !supported(isa)) {
+        return -1;
+    }
+    __atomic_store_n(&current_isa, isa, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int sf_copy_isa(void) {
+    active();
+    return __atomic_load_n(&current_isa, __ATOMIC_RELAXED);
+}
+
+const char *sf_copy_isa_name(int isa) {
+    if (isa < 0 || isa >= SF_NUM_ISAS) {
+        return NULL;
+    }
+    return isa_names[isa];
+}
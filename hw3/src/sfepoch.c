@@ -0,0 +1,184 @@
+/**
+ * Epoch-based deferred reclamation on top of sf_free_batch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfepoch.h"
+
+/*
+ * There is one global epoch.  A thread in a read section publishes the epoch it
+ * entered in; the epoch only advances once every thread in a read section has
+ * entered in the current one.  A block retired in epoch e may still be seen by
+ * sections that entered in e or e - 1, so it is freed once the epoch reaches
+ * e + 2.  Each thread keeps three bags, one per epoch mod 3: by the time a bag
+ * comes round again its blocks are three epochs old.
+ */
+#define NUM_BAGS 3
+#define BAG_MIN_CAP SF_EPOCH_BATCH
+
+typedef struct epoch_bag {
+    uint64_t epoch;
+    void **ptrs;
+    size_t count;
+    size_t cap;
+} epoch_bag;
+
+// Records live outside the heap and are never freed; a record whose thread has
+// exited is taken over, bags and all, by the next thread to register.
+typedef struct epoch_record {
+    uint64_t state;                 // 0 outside a read section, else epoch << 1 | 1
+    int in_use;
+    int nest;
+    size_t retired;
+    epoch_bag bags[NUM_BAGS];
+    struct epoch_record *next;
+} epoch_record;
+
+static uint64_t global_epoch = 1;
+static epoch_record *records = NULL;
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static __thread epoch_record *self = NULL;
+
+static size_t free_bag(epoch_bag *bag) {
+    size_t n = bag->count;
+    sf_free_batch(bag->ptrs, n);
+    bag->count = 0;
+    return n;
+}
+
+// advances the epoch if every thread in a read section has caught up with it
+static void try_advance(void) {
+    uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    epoch_record *r;
+    for (r = __atomic_load_n(&records, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        uint64_t s = __atomic_load_n(&r->state, __ATOMIC_SEQ_CST);
+        if (s != 0 && s != (e << 1 | 1)) {
+            return;
+        }
+    }
+    __atomic_compare_exchange_n(&global_epoch, &e, e + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static size_t reclaim(epoch_record *r) {
+    try_advance();
+    uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    size_t n = 0;
+    int i;
+    for (i = 0; i < NUM_BAGS; i++) {
+        if (r->bags[i].count > 0 && r->bags[i].epoch + 2 <= e) {
+            n += free_bag(&r->bags[i]);
+        }
+    }
+    return n;
+}
+
+// thread exit: leave any read section, free what is safe, give the record up
+static void release_record(void *arg) {
+    epoch_record *r = arg;
+    r->nest = 0;
+    __atomic_store_n(&r->state, 0, __ATOMIC_RELEASE);
+    reclaim(r);
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_record_key(void) {
+    pthread_key_create(&record_key, release_record);
+}
+
+static epoch_record *self_record(void) {
+    if (self != NULL) {
+        return self;
+    }
+    pthread_once(&record_key_once, make_record_key);
+    epoch_record *r;
+    for (r = __atomic_load_n(&records, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &unused, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (r == NULL) {
+        r = calloc(1, sizeof(epoch_record));
+        if (r == NULL) {
+            return NULL;
+        }
+        r->in_use = 1;
+        r->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&records, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(record_key, r);
+    self = r;
+    return r;
+}
+
+int sf_epoch_enter(void) {
+    epoch_record *r = self_record();
+    if (r == NULL) {
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    if (r->nest++ == 0) {
+        uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&r->state, e << 1 | 1, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+void sf_epoch_exit(void) {
+    epoch_record *r = self;
+    if (r == NULL || r->nest == 0) {
+        return;
+    }
+    if (--r->nest == 0) {
+        __atomic_store_n(&r->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+int sf_retire(void *pp) {
+    if (pp == NULL) {
+        return 0;
+    }
+    epoch_record *r = self_record();
+    if (r == NULL) {
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    epoch_bag *bag = &r->bags[e % NUM_BAGS];
+    if (bag->count > 0 && bag->epoch != e) {
+        free_bag(bag); // at least three epochs old
+    }
+    bag->epoch = e;
+    if (bag->count == bag->cap) {
+        size_t cap = bag->cap == 0 ? BAG_MIN_CAP : bag->cap * 2;
+        void **ptrs = realloc(bag->ptrs, cap * sizeof(void *));
+        if (ptrs == NULL) {
+            sf_errno = ENOMEM;
+            return -1;
+        }
+        bag->ptrs = ptrs;
+        bag->cap = cap;
+    }
+    bag->ptrs[bag->count++] = pp;
+    if (++r->retired % SF_EPOCH_BATCH == 0) {
+        reclaim(r);
+    }
+    return 0;
+}
+
+size_t sf_epoch_reclaim(void) {
+    epoch_record *r = self_record();
+    if (r == NULL) {
+        return 0;
+    }
+    // with no thread in a read section, two advances free every bag
+    size_t n = reclaim(r);
+    return n + reclaim(r);
+}
@@ -0,0 +1,401 @@
+/**
+ * Sampled guard-page allocations: a pool of page-sized slots between
+ * inaccessible pages, and the fault handler that says what hit them.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfguard.h"
+
+#define SLOT_UNUSED 0
+#define SLOT_LIVE   1
+#define SLOT_FREED  2
+
+typedef struct guard_slot {
+    void *pp;
+    size_t size;                // as requested
+    int state;
+    int tag;
+    long alloc_tid;
+    long free_tid;
+    int alloc_depth;
+    int free_depth;
+    void *alloc_stack[SF_GUARD_FRAMES];
+    void *free_stack[SF_GUARD_FRAMES];
+} guard_slot;
+
+// read by the fast paths in sfmm.c
+unsigned sf_guard_rate = 0;
+__thread unsigned sf_guard_countdown = 0;
+uintptr_t sf_guard_base = 0;
+size_t sf_guard_span = 0;
+
+// Slot i is the page at base + (2i + 1) pages; the even pages are the guards.
+static size_t page;
+static size_t num_slots;
+static guard_slot *slots = NULL;
+// free slots in the order they are to be reused, oldest freed first
+static size_t *avail;
+static size_t avail_head, avail_count;
+static size_t live, sampled, missed;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sigaction old_segv, old_bus;
+static __thread uint64_t rng = 0;
+
+static uint64_t next_rand(void) {
+    if (rng == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        rng = ((uint64_t)(uintptr_t)&rng ^ (uint64_t)ts.tv_nsec) | 1;
+    }
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static char *slot_page(size_t i) {
+    return (char *)sf_guard_base + (2 * i + 1) * page;
+}
+
+// the slot whose page holds pp, or NULL if pp is in a guard page
+static guard_slot *slot_of(const void *pp) {
+    size_t n = ((uintptr_t)pp - sf_guard_base) / page;
+    return n % 2 == 1 ? &slots[n / 2] : NULL;
+}
+
+/* Reports.  The fault handler may only make async-signal-safe calls, so no stdio. */
+
+static void put(const char *s) {
+    ssize_t r = write(STDERR_FILENO, s, strlen(s));
+    (void)r;
+}
+
+static void put_num(uintptr_t v, int hex) {
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    unsigned base = hex ? 16 : 10;
+    *--p = '\0';
+    do {
+        *--p = "0123456789abcdef"[v % base];
+        v /= base;
+    } while (v != 0);
+    if (hex) {
+        *--p = 'x';
+        *--p = '0';
+    }
+    put(p);
+}
+
+static void put_stack(const char *what, long tid, void **stack, int depth) {
+    put(what);
+    put(" by thread ");
+    put_num(tid, 0);
+    put(":\n");
+    backtrace_symbols_fd(stack, depth, STDERR_FILENO);
+}
+
+static void put_block(const guard_slot *s, int say_freed) {
+    put(say_freed && s->state == SLOT_FREED ? "a freed " : "a ");
+    put_num(s->size, 0);
+    put("-byte block at ");
+    put_num((uintptr_t)s->pp, 1);
+    put("\n");
+}
+
+static void put_history(const guard_slot *s) {
+    put_stack("allocated", s->alloc_tid, (void **)s->alloc_stack, s->alloc_depth);
+    if (s->state == SLOT_FREED) {
+        put_stack("freed", s->free_tid, (void **)s->free_stack, s->free_depth);
+    }
+}
+
+static void report_access(uintptr_t a) {
+    size_t n = (a - sf_guard_base) / page;
+    const guard_slot *s = NULL;
+    put("sfmm guard: ");
+    if (n % 2 == 1) {
+        s = &slots[n / 2];
+        if (s->state == SLOT_UNUSED) {
+            s = NULL;
+        } else {
+            put("use after free at ");
+            put_num(a, 1);
+            put(", ");
+            put_num(a - (uintptr_t)s->pp, 0);
+            put(" bytes into ");
+        }
+    } else {
+        // a guard page: blame the block before it or the one after, whichever is nearer
+        const guard_slot *before = n > 0 ? &slots[n / 2 - 1] : NULL;
+        const guard_slot *after = n / 2 < num_slots ? &slots[n / 2] : NULL;
+        if (before != NULL && before->state == SLOT_UNUSED) {
+            before = NULL;
+        }
+        if (after != NULL && after->state == SLOT_UNUSED) {
+            after = NULL;
+        }
+        if (before != NULL && after != NULL) {
+            if (a - ((uintptr_t)before->pp + before->size) < (uintptr_t)after->pp - a) {
+                after = NULL;
+            } else {
+                before = NULL;
+            }
+        }
+        if (before != NULL) {
+            s = before;
+            put("buffer overflow at ");
+            put_num(a, 1);
+            put(", ");
+            put_num(a - ((uintptr_t)s->pp + s->size), 0);
+            put(" bytes past the end of ");
+        } else if (after != NULL) {
+            s = after;
+            put("buffer underflow at ");
+            put_num(a, 1);
+            put(", ");
+            put_num((uintptr_t)s->pp - a, 0);
+            put(" bytes before ");
+        }
+    }
+    if (s == NULL) {
+        put("access to unused guarded memory at ");
+        put_num(a, 1);
+        put("\n");
+        return;
+    }
+    put_block(s, 1);
+    put_history(s);
+}
+
+static void report_free(void *pp, const guard_slot *s) {
+    void *stack[SF_GUARD_FRAMES];
+    int depth = backtrace(stack, SF_GUARD_FRAMES);
+    put("sfmm guard: ");
+    if (s != NULL && s->state == SLOT_FREED && s->pp == pp) {
+        put("double free of ");
+        put_block(s, 0);
+        put_stack("freed again", syscall(SYS_gettid), stack, depth);
+        put_history(s);
+        return;
+    }
+    put("free of ");
+    put_num((uintptr_t)pp, 1);
+    put(", which is not a guarded block\n");
+    put_stack("freed", syscall(SYS_gettid), stack, depth);
+    if (s != NULL && s->state != SLOT_UNUSED) {
+        put("the slot holds ");
+        put_block(s, 1);
+        put_history(s);
+    }
+}
+
+static void on_fault(int sig, siginfo_t *info, void *ctx) {
+    uintptr_t a = (uintptr_t)info->si_addr;
+    struct sigaction *old = sig == SIGBUS ? &old_bus : &old_segv;
+    if (a - sf_guard_base < sf_guard_span) {
+        report_access(a);
+    }
+    if ((old->sa_flags & SA_SIGINFO) && old->sa_sigaction != NULL) {
+        old->sa_sigaction(sig, info, ctx);
+        return;
+    }
+    if (!(old->sa_flags & SA_SIGINFO) && old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN) {
+        old->sa_handler(sig);
+        return;
+    }
+    // nothing else to hand it to: put back the default and let the access fault again
+    sigaction(sig, old, NULL);
+}
+
+// called with guard_lock held
+static int setup(size_t n) {
+    page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t span = (2 * n + 1) * page;
+    void *base = mmap(NULL, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    slots = calloc(n, sizeof(guard_slot));
+    avail = malloc(n * sizeof(size_t));
+    if (slots == NULL || avail == NULL) {
+        free(slots);
+        free(avail);
+        slots = NULL;
+        munmap(base, span);
+        return -1;
+    }
+    size_t i;
+    for (i = 0; i < n; i++) {
+        avail[i] = i;
+    }
+    num_slots = n;
+    avail_head = 0;
+    avail_count = n;
+
+    // the first backtrace loads the unwinder, which allocates: get it done here
+    void *frame;
+    backtrace(&frame, 1);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_fault;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &old_segv);
+    sigaction(SIGBUS, &sa, &old_bus);
+
+    sf_guard_base = (uintptr_t)base;
+    __atomic_store_n(&sf_guard_span, span, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sf_guard_start(size_t n, unsigned rate) {
+    pthread_mutex_lock(&guard_lock);
+    if (sf_guard_rate != 0 || sf_rt_active()) {
+        pthread_mutex_unlock(&guard_lock);
+        sf_errno = EBUSY;
+        return -1;
+    }
+    if (slots == NULL && setup(n != 0 ? n : SF_GUARD_DEFAULT_SLOTS) < 0) {
+        pthread_mutex_unlock(&guard_lock);
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    __atomic_store_n(&sf_guard_rate, rate != 0 ? rate : SF_GUARD_DEFAULT_RATE, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&guard_lock);
+    return 0;
+}
+
+void sf_guard_stop(void) {
+    __atomic_store_n(&sf_guard_rate, 0, __ATOMIC_RELAXED);
+}
+
+int sf_guard_owns(const void *pp) {
+    return SF_GUARD_OWNS(pp);
+}
+
+void sf_guard_get_stats(sf_guard_stats *stats) {
+    pthread_mutex_lock(&guard_lock);
+    stats->slots = slots != NULL ? num_slots : 0;
+    stats->live = live;
+    stats->sampled = sampled;
+    stats->missed = missed;
+    pthread_mutex_unlock(&guard_lock);
+}
+
+void *sf_guard_malloc(size_t size, int tag) {
+    unsigned rate = __atomic_load_n(&sf_guard_rate, __ATOMIC_RELAXED);
+    uint64_t r = next_rand();
+    // skip between 0 and 2 * (rate - 1) calls before the next sample, rate - 1 on average
+    sf_guard_countdown = rate > 1 ? r % (2 * rate - 1) : 0;
+    if (size == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&guard_lock);
+    if (size > page || avail_count == 0) {
+        missed++;
+        pthread_mutex_unlock(&guard_lock);
+        return NULL;
+    }
+    size_t i = avail[avail_head];
+    avail_head = (avail_head + 1) % num_slots;
+    avail_count--;
+    live++;
+    sampled++;
+    pthread_mutex_unlock(&guard_lock);
+
+    char *slot = slot_page(i);
+    if (mprotect(slot, page, PROT_READ | PROT_WRITE) < 0) {
+        pthread_mutex_lock(&guard_lock);
+        avail[(avail_head + avail_count) % num_slots] = i;
+        avail_count++;
+        live--;
+        sampled--;
+        missed++;
+        pthread_mutex_unlock(&guard_lock);
+        return NULL;
+    }
+    // against the guard before the slot, or against the one after it
+    size_t rounded = (size + 63) & ~(size_t)63;
+    guard_slot *s = &slots[i];
+    s->pp = (r >> 32) & 1 ? slot : slot + page - rounded;
+    s->size = size;
+    s->tag = tag;
+    s->alloc_tid = syscall(SYS_gettid);
+    s->alloc_depth = backtrace(s->alloc_stack, SF_GUARD_FRAMES);
+    s->free_depth = 0;
+    __atomic_store_n(&s->state, SLOT_LIVE, __ATOMIC_RELEASE);
+    return s->pp;
+}
+
+void sf_guard_free(void *pp) {
+    guard_slot *s = slot_of(pp);
+    pthread_mutex_lock(&guard_lock);
+    int ok = s != NULL && s->state == SLOT_LIVE && s->pp == pp;
+    if (ok) {
+        s->state = SLOT_FREED;
+    }
+    pthread_mutex_unlock(&guard_lock);
+    if (!ok) {
+        report_free(pp, s);
+        abort();
+    }
+    s->free_tid = syscall(SYS_gettid);
+    s->free_depth = backtrace(s->free_stack, SF_GUARD_FRAMES);
+
+    // protect first, so a late write cannot fill the page in again after it is dropped
+    size_t i = s - slots;
+    char *slot = slot_page(i);
+    mprotect(slot, page, PROT_NONE);
+    madvise(slot, page, MADV_DONTNEED); // reads back as zeros when the slot is reused
+
+    pthread_mutex_lock(&guard_lock);
+    avail[(avail_head + avail_count) % num_slots] = i;
+    avail_count++;
+    live--;
+    pthread_mutex_unlock(&guard_lock);
+}
+
+size_t sf_guard_usable_size(void *pp) {
+    guard_slot *s = slot_of(pp);
+    if (s == NULL || s->state != SLOT_LIVE || s->pp != pp) {
+        return 0;
+    }
+    return (s->size + 63) & ~(size_t)63;
+}
+
+void *sf_guard_block_of(const void *ptr) {
+    guard_slot *s = slot_of(ptr);
+    if (s == NULL || __atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SLOT_LIVE) {
+        return NULL;
+    }
+    char *pp = s->pp;
+    if ((char *)ptr < pp || (char *)ptr >= pp + ((s->size + 63) & ~(size_t)63)) {
+        return NULL;
+    }
+    return pp;
+}
+
+int sf_guard_tag(void *pp) {
+    guard_slot *s = slot_of(pp);
+    if (s == NULL || s->state != SLOT_LIVE || s->pp != pp) {
+        return -1;
+    }
+    return s->tag;
+}
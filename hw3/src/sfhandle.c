@@ -0,0 +1,209 @@
+/**
+ * Handle-backed relocatable blocks and heap compaction.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfhandle.h"
+#include "sfcopy.h"
+
+#define HANDLES_PER_CHUNK 60
+
+struct sf_hentry {
+    void *ptr;                      // payload of the block, NULL while the entry is unused
+    size_t locks;                   // number of outstanding sf_hlock calls
+    struct sf_hentry *next_free;    // next unused entry
+};
+
+// handle entries are carved out of ordinary sfmm blocks, which never move
+typedef struct sf_hchunk {
+    struct sf_hchunk *next;
+    struct sf_hentry entries[HANDLES_PER_CHUNK];
+} sf_hchunk;
+
+static sf_hchunk *chunks = NULL;
+static struct sf_hentry *free_entries = NULL;
+static void *handle_heap = NULL; // heap the table was built in
+
+static void reset_if_new_heap(void) {
+    // sf_init() starts over with a fresh heap, which takes the old table with it
+    if (handle_heap != sf_heap_start() || sf_heap_start() == sf_heap_end()) {
+        chunks = NULL;
+        free_entries = NULL;
+        handle_heap = NULL;
+    }
+}
+
+static struct sf_hentry *new_entry(void) {
+    if (free_entries == NULL) {
+        sf_hchunk *chunk = sf_malloc(sizeof(sf_hchunk));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        handle_heap = sf_heap_start();
+        chunk->next = chunks;
+        chunks = chunk;
+        int i;
+        for (i = 0; i < HANDLES_PER_CHUNK; i++) {
+            chunk->entries[i].ptr = NULL;
+            chunk->entries[i].locks = 0;
+            chunk->entries[i].next_free = free_entries;
+            free_entries = &chunk->entries[i];
+        }
+    }
+    struct sf_hentry *h = free_entries;
+    free_entries = h->next_free;
+    h->next_free = NULL;
+    return h;
+}
+
+sf_handle sf_halloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    reset_if_new_heap();
+    // take the entry first, so a new chunk is not placed after the block
+    struct sf_hentry *h = new_entry();
+    if (h == NULL) {
+        return NULL;
+    }
+    void *pp = sf_malloc(size);
+    if (pp == NULL) {
+        h->next_free = free_entries;
+        free_entries = h;
+        return NULL;
+    }
+    h->ptr = pp;
+    h->locks = 0;
+    return h;
+}
+
+void *sf_hlock(sf_handle h) {
+    h->locks++;
+    return h->ptr;
+}
+
+void sf_hunlock(sf_handle h) {
+    if (h->locks > 0) {
+        h->locks--;
+    }
+}
+
+void sf_hfree(sf_handle h) {
+    if (h == NULL || h->ptr == NULL || h->locks != 0) {
+        abort();
+        return;
+    }
+    sf_free(h->ptr);
+    h->ptr = NULL;
+    h->next_free = free_entries;
+    free_entries = h;
+}
+
+static int by_address(const void *a, const void *b) {
+    const struct sf_hentry *x = *(struct sf_hentry * const *)a;
+    const struct sf_hentry *y = *(struct sf_hentry * const *)b;
+    return (x->ptr > y->ptr) - (x->ptr < y->ptr);
+}
+
+/*
+ * Moves the allocated block after the free block fp down into fp's place.
+ * The free space ends up above the moved block and is merged with whatever follows.
+ *
+ * @return The (coalesced) free block above the moved block.
+ */
+static sf_block *slide_down(sf_block *fp, struct sf_hentry *h) {
+    sf_block *mp = next_blockp(fp);
+    size_t fsize = get_size(fp);
+    size_t msize = get_size(mp);
+    size_t prev_alloc = get_prev_alloc(fp);
+
+    remove_free_block(fp);
+    sf_pagemap_set_tag(fp, sf_pagemap_tag(mp)); // same block, same tag
+    sf_pagemap_clear(mp); // fp's start is kept, mp's goes away
+    // payload runs up to the prev_footer of the next block; sf_copy allows a lower destination
+    sf_copy(fp->body.payload, mp->body.payload, msize - sizeof(sf_header));
+    fp->header = (msize & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | prev_alloc;
+    h->ptr = fp->body.payload;
+
+    // prev_footer of the new free block is the moved payload's last row, leave it alone
+    sf_block *free_bp = next_blockp(fp);
+    free_bp->header = (fsize & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
+    sf_block *footer = ftrp(free_bp);
+    footer->header = free_bp->header;
+    sf_block *next = next_blockp(free_bp);
+    next->header = next->header & ~(PREV_BLOCK_ALLOCATED);
+
+    add_free_list(free_list_index(fsize), free_bp);
+    return coalesce(free_bp);
+}
+
+static size_t compact(void) {
+    reset_if_new_heap();
+    if (chunks == NULL) {
+        return 0;
+    }
+
+    // collect the unlocked blocks in address order
+    size_t count = 0;
+    sf_hchunk *chunk;
+    int i;
+    for (chunk = chunks; chunk != NULL; chunk = chunk->next) {
+        for (i = 0; i < HANDLES_PER_CHUNK; i++) {
+            if (chunk->entries[i].ptr != NULL && chunk->entries[i].locks == 0) {
+                count++;
+            }
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    // scratch space comes from the C library, so it cannot land in a hole we are closing
+    struct sf_hentry **movable = malloc(count * sizeof(struct sf_hentry *));
+    if (movable == NULL) {
+        return 0;
+    }
+    size_t n = 0;
+    for (chunk = chunks; chunk != NULL; chunk = chunk->next) {
+        for (i = 0; i < HANDLES_PER_CHUNK; i++) {
+            if (chunk->entries[i].ptr != NULL && chunk->entries[i].locks == 0) {
+                movable[n++] = &chunk->entries[i];
+            }
+        }
+    }
+    qsort(movable, n, sizeof(struct sf_hentry *), by_address);
+
+    // walk the heap from the first block after the prologue
+    sf_block *prologue = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // 48
+    sf_block *bp = next_blockp(prologue);
+    size_t k = 0;
+    size_t moved = 0;
+    while (get_size(bp) != 0) { // epilogue
+        if (!get_alloc(bp) && !is_wilderness(bp)) {
+            sf_block *mp = next_blockp(bp);
+            while (k < n && (void *)movable[k]->ptr < (void *)mp->body.payload) {
+                k++;
+            }
+            if (k < n && movable[k]->ptr == (void *)mp->body.payload) {
+                bp = slide_down(bp, movable[k]);
+                k++;
+                moved++;
+                continue;
+            }
+        }
+        bp = next_blockp(bp);
+    }
+
+    free(movable);
+    return moved;
+}
+
+size_t sf_compact(void) {
+    sf_heap_enter();
+    size_t moved = compact();
+    sf_heap_leave();
+    return moved;
+}
@@ -0,0 +1,76 @@
+/**
+ * Latency histograms for the allocator entry points.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfhist.h"
+
+static sf_hist hists[SF_NUM_OPS];
+
+static const char *op_names[SF_NUM_OPS] = {
+    "sf_malloc", "sf_free", "sf_realloc", "sf_memalign"
+};
+
+#ifdef SF_HIST
+__thread int sf_hist_depth = 0;
+__thread int sf_hist_events = 0;
+__thread uint64_t sf_hist_start = 0;
+
+void sf_hist_record(int op, uint64_t cycles, int events) {
+    sf_hist *h = &hists[op];
+    int b = cycles == 0 ? 0 : 63 - __builtin_clzll(cycles);
+    if (b >= SF_HIST_BUCKETS) {
+        b = SF_HIST_BUCKETS - 1;
+    }
+    sf_hist_bucket *bucket = &h->buckets[b];
+    h->calls++;
+    h->total_cycles += cycles;
+    if (cycles > h->max_cycles) {
+        h->max_cycles = cycles;
+    }
+    bucket->calls++;
+    bucket->grew += (events & SF_EV_GROW) != 0;
+    bucket->split += (events & SF_EV_SPLIT) != 0;
+    bucket->coalesced += (events & SF_EV_COALESCE) != 0;
+    bucket->copied += (events & SF_EV_COPY) != 0;
+}
+#endif
+
+const sf_hist *sf_hist_get(int op) {
+    if (op < 0 || op >= SF_NUM_OPS) {
+        return NULL;
+    }
+    return &hists[op];
+}
+
+void sf_hist_reset(void) {
+    memset(hists, 0, sizeof(hists));
+}
+
+void sf_hist_dump(FILE *out) {
+    int op, b;
+    for (op = 0; op < SF_NUM_OPS; op++) {
+        const sf_hist *h = &hists[op];
+        if (h->calls == 0) {
+            continue;
+        }
+        fprintf(out, "%s: %llu calls, mean %llu cycles, max %llu cycles\n", op_names[op],
+                (unsigned long long)h->calls, (unsigned long long)(h->total_cycles / h->calls),
+                (unsigned long long)h->max_cycles);
+        fprintf(out, "  %-24s %10s %8s %8s %8s %8s\n", "cycles", "calls", "grow", "split", "coalesce", "copy");
+        for (b = 0; b < SF_HIST_BUCKETS; b++) {
+            const sf_hist_bucket *k = &h->buckets[b];
+            if (k->calls == 0) {
+                continue;
+            }
+            fprintf(out, "  [%10llu, %10llu) %10llu %8llu %8llu %8llu %8llu\n",
+                    b == 0 ? 0ULL : 1ULL << b, 1ULL << (b + 1), (unsigned long long)k->calls,
+                    (unsigned long long)k->grew, (unsigned long long)k->split,
+                    (unsigned long long)k->coalesced, (unsigned long long)k->copied);
+        }
+    }
+}
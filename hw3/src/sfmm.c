@@ -3,12 +3,107 @@
  * Do not submit your assignment with a main function in this file.
  * If you submit with a main function in this file, you will get a zero.
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfmm_internal.h"
+#include "sfhist.h"
+#include "sfcopy.h"
+#include "sftag.h"
+#include "sfguard.h"
 #include <errno.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Everything in [sf_clean_start, sf_heap_end() - 16) is known to hold zeros:
+// it lies inside the wilderness and has not been written since the page provider
+// handed it over zero-filled.  The sfutil heap is carved out of a malloc()'d region,
+// so with sfutil nothing is ever known to be clean.
+// The last 16 bytes are always the wilderness footer and the epilogue header.
+static void *sf_clean_start = NULL;
+// sf_clean_start as it was just before the last call to place()
+static void *sf_placed_clean_start = NULL;
+
+// A free block uses its links and the slot word after them; the rest of its body is unused.
+#define FREE_BODY_USED (2 * sizeof(sf_block *) + sizeof(size_t))
+
+// Out-of-band index of each free list: block sizes sit in a dense array, so
+// find_fit scans that array and only touches the block it picks.  Every free
+// block keeps (position << 4 | list) in the slot word after its links.
+typedef struct fit_index {
+    uint32_t *sizes;
+    sf_block **blocks;
+    size_t count;
+    size_t cap;
+} fit_index;
+static fit_index fit_lists[NUM_FREE_LISTS];
+static int fit_index_ok = 0; // cleared if the side arrays cannot grow; find_fit walks the lists then
+int sf_use_fit_index = 1;
+
+// The heap belongs to the thread that set it up (or last called sf_heap_claim).
+// Any other thread's sf_free pushes the block onto remote_frees, a lock-free
+// stack threaded through the first payload word, and the owner drains it in
+// one batch at its next sf_malloc or sf_free.
+static __thread char sf_thread_tag;
+static void *sf_owner = NULL;
+static sf_block *remote_frees = NULL;
+static void do_free(void *pp);
+static void free_user(void *pp);
+
+// While the sf_free_async maintenance thread runs, it and the owner take turns
+// at the heap: whichever holds heap_busy may touch it.  The owner takes it on
+// entry to every public call (nested calls take it once) and sets owner_waiting
+// while it spins, which makes the maintenance thread give the heap back after
+// the block it is on.  With no maintenance thread nothing is taken.
+static int async_running = 0;
+static int heap_busy = 0;
+static int owner_waiting = 0;
+static __thread int heap_depth = 0;
+static __thread int heap_held = 0;
+static sf_block *async_frees = NULL;
+static size_t async_pending = 0;
+static size_t async_max_pending = 0;
+static int async_stopping = 0;
+static pthread_t async_thread;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_wake = PTHREAD_COND_INITIALIZER;
+
+// Blocks carved out ahead of time by sf_prefill, one exact block size per class.
+// They are marked allocated, so they stay off the free lists and out of coalescing
+// until do_malloc hands them out; each links to the next through its first payload row.
+typedef struct prefill_stash {
+    size_t asize;
+    sf_block *head;
+    size_t count;
+    size_t target;  // what the sf_free_async thread tops count back up to
+} prefill_stash;
+static prefill_stash prefilled[NUM_FREE_LISTS];
+
+// Heap size limits from sf_set_limit, 0 for none.  Soft limit callbacks are held
+// back until the end of the sf_malloc that grew the heap past it, so they can
+// free and allocate without pulling blocks out from under the allocator.
+typedef struct pressure_callback {
+    sf_pressure_fn fn;
+    void *arg;
+} pressure_callback;
+static size_t soft_limit = 0;
+static size_t hard_limit = 0;
+static int soft_crossed = 0;    // since the limit was set or the heap set up
+static int soft_pending = 0;    // crossed, callbacks not run yet
+static int in_pressure = 0;     // callbacks running
+static pressure_callback pressure_callbacks[SF_MAX_PRESSURE_CALLBACKS];
+
+// Set by sf_rt_init until the heap is set up again: the heap never grows or
+// gives pages back, and every step of sf_malloc and sf_free is bounded.
+static int rt_mode = 0;
 
 size_t get_size(sf_block *bp) {
     return bp->header & BLOCK_SIZE_MASK;
@@ -34,30 +129,70 @@ void *prev_blockp(sf_block *bp) {
     return (sf_block *)((void *)(bp) - ((bp->prev_footer) & BLOCK_SIZE_MASK));
 }
 
+// drops everything that points into the heap: free lists, fit index, page map,
+// sf_prefill blocks, the clean run and the mode it was set up in
+static void forget_heap(void) {
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        // dummy "sentinel" node, does not contain any data
+        sf_free_list_heads[i].body.links.next = &sf_free_list_heads[i];
+        sf_free_list_heads[i].body.links.prev = &sf_free_list_heads[i];
+    }
+
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        fit_lists[i].count = 0;
+        prefilled[i].head = NULL;
+        prefilled[i].count = 0;
+        prefilled[i].target = 0;
+    }
+    fit_index_ok = 1;
+    sf_pagemap_reset();
+    soft_crossed = 0;
+    rt_mode = 0;
+    soft_pending = 0;
+    sf_tag_reset();
+    __atomic_store_n(&remote_frees, NULL, __ATOMIC_RELAXED);
+    sf_clean_start = NULL;
+    sf_placed_clean_start = NULL;
+}
+
+int sf_heap_forget(void) {
+    if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        sf_errno = EBUSY; // its queue still holds blocks of this heap
+        return -1;
+    }
+    forget_heap();
+    return 0;
+}
+
 int sf_init(void) {
     // Create initial empty heap
-    sf_mem_init();
+    if (sf_heap_init() < 0) {
+        return -1;
+    }
+    __atomic_store_n(&sf_owner, &sf_thread_tag, __ATOMIC_RELAXED);
+    // first page, the provider may not have any memory behind the heap start yet
+    if (sf_heap_grow() == NULL) { // extend the heap
+        return -1;
+    }
+    SF_HIST_NOTE(SF_EV_GROW);
     // alignment padding
 
     // prologue header
-    sf_block *prologue = (sf_block *)((void *)sf_mem_start() + (sizeof(sf_header) * 6)); // 48
+    sf_block *prologue = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // 48
     prologue->header = (64 & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED | THIS_BLOCK_ALLOCATED;
 
     // prologue footer
-    sf_block *p_footer = (sf_block *)((void *)sf_mem_start() + (sizeof(sf_header) * 6) + (sizeof(sf_header) * 7));
+    sf_block *p_footer = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6) + (sizeof(sf_header) * 7));
     p_footer->header = (64 & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED | THIS_BLOCK_ALLOCATED;
 
-    if (sf_mem_grow() == NULL) { // extend the heap
-        return -1;
-    }
-
     // epilogue header
-    sf_block *epilogue = (sf_block *)((void *)sf_mem_end() - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_block *epilogue = (sf_block *)((void *)sf_heap_end() - (sizeof(sf_header) + sizeof(sf_footer)));
     epilogue->header = (0 & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED;
 
     // the remainder of this memory should be inserted into the free list as a single block
     // this will be a "wilderness" block
-    sf_block *wilderness = (sf_block *)((void *)sf_mem_start() + (sizeof(sf_header) * 6) + (sizeof(sf_header) * 8));
+    sf_block *wilderness = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6) + (sizeof(sf_header) * 8));
     wilderness->prev_footer = p_footer->header;
     wilderness->header = (3968 & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED; // block not alloc
     // wilderness footer
@@ -67,19 +202,13 @@ int sf_init(void) {
     // epilogue->prev_footer = wilderness footer
     epilogue->prev_footer = w_footer->header;
 
-    // initialize sf_free_list_heads
-    int i;
-    for (i = 0; i < NUM_FREE_LISTS; i++) {
-        // dummy "sentinel" node, does not contain any data
-        sf_free_list_heads[i].body.links.next = &sf_free_list_heads[i];
-        sf_free_list_heads[i].body.links.prev = &sf_free_list_heads[i];
-    }
+    forget_heap();
 
     // struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
-    sf_free_list_heads[NUM_FREE_LISTS-1].body.links.next = wilderness;
-    sf_free_list_heads[NUM_FREE_LISTS-1].body.links.prev = wilderness;
-    wilderness->body.links.next = &sf_free_list_heads[NUM_FREE_LISTS-1];
-    wilderness->body.links.prev = &sf_free_list_heads[NUM_FREE_LISTS-1];
+    add_free_list(NUM_FREE_LISTS-1, wilderness);
+
+    // wilderness header and links have been written, the rest is as fresh as the page
+    sf_clean_start = sf_heap_zeroed() ? (void *)wilderness->body.payload + FREE_BODY_USED : sf_heap_end();
 
     return 0;
 }
@@ -108,11 +237,120 @@ int free_list_index(size_t size) {
     return start;
 }
 
-static void *find_fit(size_t size) {
+static size_t *index_slot(sf_block *p) {
+    return (size_t *)((void *)p->body.payload + 2 * sizeof(sf_block *));
+}
+
+static void index_add(int index, sf_block *p) {
+    fit_index *fx = &fit_lists[index];
+    if (!fit_index_ok) {
+        return;
+    }
+    if (fx->count == fx->cap) {
+        // the index lives outside the heap, so growing it cannot disturb the lists
+        size_t cap = fx->cap ? fx->cap * 2 : 64;
+        uint32_t *sizes = realloc(fx->sizes, cap * sizeof(uint32_t));
+        if (sizes != NULL) {
+            fx->sizes = sizes;
+        }
+        sf_block **blocks = realloc(fx->blocks, cap * sizeof(sf_block *));
+        if (blocks != NULL) {
+            fx->blocks = blocks;
+        }
+        if (sizes == NULL || blocks == NULL) {
+            fit_index_ok = 0;
+            return;
+        }
+        fx->cap = cap;
+    }
+    fx->sizes[fx->count] = get_size(p);
+    fx->blocks[fx->count] = p;
+    *index_slot(p) = (fx->count << 4) | index;
+    fx->count++;
+}
+
+static void index_remove(sf_block *p) {
+    if (!fit_index_ok) {
+        return;
+    }
+    size_t slot = *index_slot(p);
+    fit_index *fx = &fit_lists[slot & 0xf];
+    size_t pos = slot >> 4;
+    // move the last entry into the hole
+    fx->count--;
+    if (pos != fx->count) {
+        fx->sizes[pos] = fx->sizes[fx->count];
+        fx->blocks[pos] = fx->blocks[fx->count];
+        *index_slot(fx->blocks[pos]) = (pos << 4) | (slot & 0xf);
+    }
+}
+
+// position of the most recently indexed block of at least need bytes, or -1
+static long index_scan(fit_index *fx, uint32_t need) {
+    size_t n = fx->count;
+#ifdef __SSE2__
+    // unsigned x >= need as a signed compare of the biased values against need - 1
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    const __m128i key = _mm_set1_epi32((int)(need ^ 0x80000000u) - 1);
+    while (n >= 4) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(fx->sizes + n - 4)), bias);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, key)));
+        if (mask) {
+            return n - 4 + (31 - __builtin_clz(mask));
+        }
+        n -= 4;
+    }
+#endif
+    while (n > 0) {
+        n--;
+        if (fx->sizes[n] >= need) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Real-time search: at most SF_RT_SEARCH_DEPTH blocks of each list are looked at,
+ * so the search takes a bounded number of steps whatever the lists hold.  Every
+ * block in a class above start is bigger than anything start's class holds, so
+ * only the request's own class, the catch-all class and the wilderness can turn
+ * a block down.  This can still miss a fit further down one of those lists.
+ */
+static void *find_fit_bounded(size_t size, int start) {
+    int i;
+    for (i = start; i < NUM_FREE_LISTS; i++) {
+        sf_block *head = &sf_free_list_heads[i];
+        sf_block *bp = head->body.links.next;
+        int n;
+        for (n = 0; n < SF_RT_SEARCH_DEPTH && bp != head; n++) {
+            if (get_size(bp) >= size) {
+                return bp;
+            }
+            bp = bp->body.links.next;
+        }
+    }
+    return NULL;
+}
+
+// start is free_list_index(size), which callers usually know already
+static void *find_fit(size_t size, int start) {
+    if (rt_mode) {
+        return find_fit_bounded(size, start);
+    }
+    if (sf_use_fit_index && fit_index_ok) {
+        int i;
+        for (i = start; i < NUM_FREE_LISTS; i++) {
+            long pos = index_scan(&fit_lists[i], size);
+            if (pos >= 0) {
+                return fit_lists[i].blocks[pos];
+            }
+        }
+        return NULL;
+    }
     // First fit search
     sf_block *ptr = NULL;
     sf_block *head = NULL;
-    int start = free_list_index(size);
     int i;
     // struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
     for (i = start; i < NUM_FREE_LISTS; i++) {
@@ -130,7 +368,7 @@ static void *find_fit(size_t size) {
 }
 
 int is_wilderness(sf_block *p) {
-    sf_block *epilogue = (sf_block *)((void *)sf_mem_end() - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_block *epilogue = (sf_block *)((void *)sf_heap_end() - (sizeof(sf_header) + sizeof(sf_footer)));
     if (next_blockp(p) == epilogue) {
         return 1;
     } else {
@@ -139,6 +377,7 @@ int is_wilderness(sf_block *p) {
 }
 
 void remove_free_block(sf_block *p) {
+    index_remove(p);
     (p->body.links.prev)->body.links.next = p->body.links.next;
     (p->body.links.next)->body.links.prev = p->body.links.prev;
     p->body.links.prev = NULL;
@@ -150,10 +389,12 @@ void add_free_list(int index, sf_block *p) { // adds to the beginning of the fre
     p->body.links.next = sf_free_list_heads[index].body.links.next;
     sf_free_list_heads[index].body.links.next = p;
     (p->body.links.next)->body.links.prev = p;
+    index_add(index, p);
+    sf_pagemap_set(p);
 }
 
 void new_epilogue() {
-    sf_block *epilogue = (sf_block *)((void *)sf_mem_end() - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_block *epilogue = (sf_block *)((void *)sf_heap_end() - (sizeof(sf_header) + sizeof(sf_footer)));
     epilogue->header = (0 & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED;
     sf_block *wild = (sf_block *)sf_free_list_heads[NUM_FREE_LISTS-1].body.links.prev;
     if (wild != &sf_free_list_heads[NUM_FREE_LISTS-1]) {
@@ -161,7 +402,7 @@ void new_epilogue() {
     }
 }
 
-static void *coalesce(sf_block *p) {
+void *coalesce(sf_block *p) {
     size_t prev_alloc = get_prev_alloc(p); // prev_alloc (this block)
     size_t size = get_size(p); // size (this block)
     sf_block *next_block = next_blockp(p);
@@ -180,6 +421,7 @@ static void *coalesce(sf_block *p) {
         //debug("case 2");
         remove_free_block(p); // remove this free block
         remove_free_block(next_block); // remove old free block
+        sf_pagemap_clear(next_block);
 
         size += get_size(next_block); // size
         p->header = (size & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED; // header
@@ -191,12 +433,9 @@ static void *coalesce(sf_block *p) {
         // free, this, alloc
         //debug("case 3");
         sf_block *prev_block = prev_blockp(p);
-        if (is_wilderness(p)) { // case of right after expanded the heap
-            remove_free_block(prev_block); // remove old free block
-        } else {
-            remove_free_block(prev_block); // remove old free block
-            remove_free_block(p);
-        }
+        remove_free_block(prev_block); // remove old free block
+        remove_free_block(p);
+        sf_pagemap_clear(p);
 
         start = prev_block;
         size += get_size(prev_blockp(p)); // size
@@ -216,6 +455,8 @@ static void *coalesce(sf_block *p) {
         remove_free_block(prev_block); // remove old free blocks
         remove_free_block(p);
         remove_free_block(next_block);
+        sf_pagemap_clear(p);
+        sf_pagemap_clear(next_block);
 
         start = prev_block;
         size += get_size(prev_blockp(p)) + get_size(next_block); // size
@@ -228,6 +469,7 @@ static void *coalesce(sf_block *p) {
         footer->header = prev_block->header; // footer
     }
 
+    SF_HIST_NOTE(SF_EV_COALESCE);
     int index = free_list_index(size);
     if (is_wilderness(start)) {
         index = NUM_FREE_LISTS - 1;
@@ -241,6 +483,7 @@ static void *coalesce(sf_block *p) {
 static void place(sf_block *ptr, size_t asize) {
     // debug("calling place");
     int check_wilderness = is_wilderness(ptr);
+    sf_placed_clean_start = sf_clean_start;
     // debug("%p", ptr);
     // check if can split without splinters
     // splinter = block less than the minimum block size
@@ -248,6 +491,7 @@ static void place(sf_block *ptr, size_t asize) {
     // can split
     if (remainder_size >= 64) {
         // splitting
+        SF_HIST_NOTE(SF_EV_SPLIT);
         // "lower part" - allocation
         sf_block *lower = ptr;
         remove_free_block(lower);
@@ -275,11 +519,11 @@ static void place(sf_block *ptr, size_t asize) {
         // upper next, prev
         if (check_wilderness) {
             // put back wilderness block
-            int index = NUM_FREE_LISTS - 1;
-            sf_free_list_heads[index].body.links.prev = upper;
-            sf_free_list_heads[index].body.links.next = upper;
-            upper->body.links.prev = &sf_free_list_heads[index];
-            upper->body.links.next = &sf_free_list_heads[index];
+            add_free_list(NUM_FREE_LISTS - 1, upper);
+            // the allocated part will be written by the caller, as are the new header and links
+            if (sf_clean_start < (void *)upper->body.payload + FREE_BODY_USED) {
+                sf_clean_start = (void *)upper->body.payload + FREE_BODY_USED;
+            }
         } else {
             int index = free_list_index(remainder_size);
             // add remainder to freelist
@@ -290,6 +534,10 @@ static void place(sf_block *ptr, size_t asize) {
 
     } else {
         // no split
+        if (check_wilderness) {
+            // whole wilderness handed out, nothing left that is known to be clean
+            sf_clean_start = sf_heap_end();
+        }
         // place data in free space
         if (get_prev_alloc(ptr)) {
             ptr->header = (asize & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | PREV_BLOCK_ALLOCATED;
@@ -316,6 +564,7 @@ static void split(sf_block *ptr, size_t asize) {
     // can split
     if (remainder_size >= 64) {
         // splitting
+        SF_HIST_NOTE(SF_EV_SPLIT);
         // "lower part" - allocation
         sf_block *lower = ptr;
         // remove_free_block(lower);
@@ -338,16 +587,15 @@ static void split(sf_block *ptr, size_t asize) {
         upper_footer->header = (remainder_size & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
         // upper prev_footer
         upper->prev_footer = lower->header;
+        // the block after the remainder used to follow an allocated block
+        sf_block *after = next_blockp(upper);
+        after->header = after->header & ~(PREV_BLOCK_ALLOCATED);
 
         // insert remainder back into the appropriate freelist
         // upper next, prev
         if (check_wilderness) {
             // put back wilderness block
-            int index = NUM_FREE_LISTS - 1;
-            sf_free_list_heads[index].body.links.prev = upper;
-            sf_free_list_heads[index].body.links.next = upper;
-            upper->body.links.prev = &sf_free_list_heads[index];
-            upper->body.links.next = &sf_free_list_heads[index];
+            add_free_list(NUM_FREE_LISTS - 1, upper);
         } else {
             int index = free_list_index(remainder_size);
             // add remainder to freelist
@@ -387,12 +635,12 @@ int valid_pointer(void *pp) {
     int not_alligned = (long int)pp % 64 != 0;
 
     // bp->header addr < prologue_end addr
-    sf_block *prologue = (sf_block *)((void *)sf_mem_start() + (sizeof(sf_header) * 6)); // 48
+    sf_block *prologue = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // 48
     sf_block *prologue_end = ftrp(prologue) + sizeof(sf_footer);
     int before_end_prologue = (((void *)(bp) + sizeof(sf_header)) < ((void *)prologue_end));
 
     // bp->footer addr > epilogue_header addr
-    int after_start_epilogue = (void *)ftrp(bp) > ((void *)sf_mem_end() - sizeof(sf_header));
+    int after_start_epilogue = (void *)ftrp(bp) > ((void *)sf_heap_end() - sizeof(sf_header));
 
     if (not_alligned || (get_alloc(bp) == 0)
         || before_end_prologue || after_start_epilogue
@@ -403,19 +651,26 @@ int valid_pointer(void *pp) {
     return 1;
 }
 
-void *sf_malloc(size_t size) { // size in bytes
-    // initialize the heap if this is first call, heap empty
-    if (sf_mem_start() == sf_mem_end()) {
-        sf_init();
+// a new page starting at pg has just been merged into the wilderness
+static void track_fresh_page(void *pg) {
+    if (!sf_heap_zeroed()) {
+        sf_clean_start = sf_heap_end();
+    } else if (sf_clean_start < pg - (sizeof(sf_header) + sizeof(sf_footer))) {
+        // the clean run reached the old footer and epilogue, clear them and the page's
+        // stale links to keep it contiguous
+        memset(pg - (sizeof(sf_header) + sizeof(sf_footer)), 0,
+               sizeof(sf_header) + sizeof(sf_footer) + FREE_BODY_USED);
+    } else {
+        // old epilogue became the header, links may have been written after it
+        sf_clean_start = pg + FREE_BODY_USED;
     }
+}
 
-    if (size == 0) {
-        // without setting sf_errno
-        return NULL;
-    }
-    // if the request size is non-zero, then should determine the size of block
+// block size for a request of size bytes: header plus payload, rounded up to 64
+// the largest payload whose block size still fits in the size field of a header
+#define MAX_REQUEST ((size_t)BLOCK_SIZE_MASK - 64)
 
-    // aligned to 64-byte boundaries
+static size_t block_size(size_t size) {
     size_t asize = size + sizeof(sf_header); // Adjust block size
 
     if (asize > 64 && (asize % 64 != 0)) {
@@ -424,28 +679,62 @@ void *sf_malloc(size_t size) { // size in bytes
     } else if (asize < 64) {
         asize = 64;
     }
+    return asize;
+}
 
-    // search free list
-    sf_block *bp = find_fit(asize);
-    if (bp != NULL) {
-        place(bp, asize);
-        return bp->body.payload;
+static size_t heap_size(void) {
+    return (char *)sf_heap_end() - (char *)sf_heap_start();
+}
+
+static void note_heap_size(void) {
+    if (soft_limit != 0 && !soft_crossed && heap_size() > soft_limit) {
+        soft_crossed = 1;
+        soft_pending = 1;
+    }
+}
+
+static void run_pressure_callbacks(int level) {
+    size_t size = heap_size();
+    int i;
+    in_pressure = 1;
+    for (i = 0; i < SF_MAX_PRESSURE_CALLBACKS; i++) {
+        if (pressure_callbacks[i].fn != NULL) {
+            pressure_callbacks[i].fn(level, size, pressure_callbacks[i].arg);
+        }
     }
+    in_pressure = 0;
+}
 
-    // No fit found. Get more memory and place the block.
-    int amount = asize;
+/*
+ * Grows the heap a page at a time until the wilderness is at least asize bytes.
+ * Always grows at least once.
+ *
+ * @return The wilderness, or NULL with sf_errno set to ENOMEM.
+ */
+static sf_block *grow_wilderness(size_t asize) {
+    if (rt_mode) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    sf_block *bp;
     do {
-        sf_block *ptr = sf_mem_grow(); // grow heap
+        if (hard_limit != 0 && heap_size() + PAGE_SZ > hard_limit) {
+            sf_errno = ENOMEM;
+            return NULL;
+        }
+        sf_block *ptr = sf_heap_grow(); // grow heap
 
         if (ptr == NULL) { // error, cannot grow any more, returns NULL and sets sf_errno to ENOMEM
             return NULL;
         }
+        SF_HIST_NOTE(SF_EV_GROW);
+        note_heap_size();
         new_epilogue(); // new epilogue header
         // old epilogue becomes the header of the new block
         sf_block *page = (sf_block *)((void *)ptr - (sizeof(sf_header) + sizeof(sf_footer)));
-        sf_block *prev_block = prev_blockp(page);
-
-        if (get_alloc(prev_block)) { // prev_block is allocated
+        // the old epilogue's prev_footer is stale once the last block is allocated
+        // (grow_in_place may have stretched it over the wilderness), its header bit is not
+        if (get_prev_alloc(page)) { // prev_block is allocated
             page->header = (PAGE_SZ & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
         } else {
             page->header = (PAGE_SZ & BLOCK_SIZE_MASK);
@@ -458,39 +747,485 @@ void *sf_malloc(size_t size) { // size in bytes
         int no_wild = sf_free_list_heads[NUM_FREE_LISTS-1].body.links.next == &sf_free_list_heads[NUM_FREE_LISTS-1];
         if (no_wild) {
             add_free_list(NUM_FREE_LISTS-1, page);
+        } else {
+            // linked like any other free block, coalesce takes it off again
+            add_free_list(free_list_index(PAGE_SZ), page);
         }
 
         // coalesce newly allocated page with any wilderness block immediately preceeding it
         // insert new wilderness block at the beginning of the last freelist
         bp = coalesce(page);
+        track_fresh_page(ptr);
 
-        amount -= PAGE_SZ;
-    } while (amount > PAGE_SZ);
-
-    // if cannot satisfy request, sf_malloc set sf_errno to ENOMEM and return NULL
+        // keep going until the wilderness itself can hold the block
+    } while (get_size(bp) < asize);
+    return bp;
+}
 
-    // place
+// find_fit, growing the heap if nothing fits, then place
+static sf_block *allocate_block(size_t asize, int index) {
+    // search free list
+    sf_block *bp = find_fit(asize, index);
+    if (bp == NULL) {
+        // No fit found. Get more memory and place the block.
+        // if cannot satisfy request, sf_malloc set sf_errno to ENOMEM and return NULL
+        bp = grow_wilderness(asize);
+        if (bp == NULL) {
+            return NULL;
+        }
+    }
     place(bp, asize);
+    return bp;
+}
+
+static size_t discard_free_pages(void);
+static void flush_prefilled(void);
+static size_t drain_remote_frees(void);
+
+/*
+ * Called when growing the heap ran into the hard limit: gives back everything
+ * the allocator is holding on to and lets the callbacks free what they can.
+ *
+ * @return Nonzero if the allocation is worth trying again.
+ */
+static int relieve_pressure(void) {
+    if (rt_mode || hard_limit == 0 || in_pressure || heap_size() + PAGE_SZ <= hard_limit) {
+        return 0;
+    }
+    flush_prefilled();
+    drain_remote_frees();
+    run_pressure_callbacks(SF_PRESSURE_HARD);
+    discard_free_pages();
+    return 1;
+}
+
+// asize is already a block size and index its free list
+static void *malloc_block(size_t asize, int index) {
+    // initialize the heap if this is first call, heap empty
+    if (sf_heap_start() == sf_heap_end()) {
+        if (sf_init() < 0) {
+            return NULL;
+        }
+    }
+
+    prefill_stash *ps = &prefilled[index];
+    if (ps->head != NULL && ps->asize == asize) {
+        sf_block *bp = ps->head;
+        ps->head = bp->body.links.next;
+        ps->count--;
+        // carved long ago, none of it can be assumed clean
+        sf_placed_clean_start = sf_clean_start;
+        return bp->body.payload;
+    }
+
+    int saved_errno = sf_errno;
+    sf_block *bp = allocate_block(asize, index);
+    if (bp == NULL && relieve_pressure()) {
+        sf_errno = saved_errno;
+        bp = allocate_block(asize, index);
+    }
+    if (bp == NULL) {
+        return NULL;
+    }
     return bp->body.payload;
+}
 
-    // if no free block big enough, then use sf_mem_grow to request for more memory
-    // requests larger than 1 page, more calls might be required
-        // coalesce the newly allocated page with any wilderness block immidiately preceding it
-        // insert new (wilderness) block at the begininng of the last freelist
+static void *do_malloc(size_t size) { // size in bytes
+    if (size == 0) {
+        // without setting sf_errno
+        if (sf_heap_start() == sf_heap_end()) {
+            sf_init();
+        }
+        return NULL;
+    }
+    // if the request size is non-zero, then should determine the size of block
+    if (size > MAX_REQUEST) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    // aligned to 64-byte boundaries
+    size_t asize = block_size(size);
+    return malloc_block(asize, free_list_index(asize));
 }
 
-void sf_free(void *pp) {
-    // pointer address in int = (sf_block *)((void *)(pointer))
+static int owns_heap(void) {
+    void *owner = __atomic_load_n(&sf_owner, __ATOMIC_RELAXED);
+    return owner == NULL || owner == &sf_thread_tag;
+}
 
-    // verify that the pointer being pass belongs to an allocated block
-    // examining the fields of the block header and footer
+// called by the owner: frees every block other threads have handed back
+static size_t drain_remote_frees(void) {
+    if (__atomic_load_n(&remote_frees, __ATOMIC_RELAXED) == NULL) {
+        return 0;
+    }
+    sf_block *bp = __atomic_exchange_n(&remote_frees, NULL, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (bp != NULL) {
+        sf_block *next = bp->body.links.next;
+        free_user(bp->body.payload);
+        bp = next;
+        n++;
+    }
+    return n;
+}
 
-    if (!valid_pointer(pp)) {
+// The public calls drain the queue on the way in, except in real-time mode,
+// where its length would count against them; the owner calls sf_heap_drain then.
+static void drain_on_entry(void) {
+    if (!rt_mode) {
+        drain_remote_frees();
+    }
+}
+
+// called by any other thread: only the cheap checks, the owner validates the rest
+static void remote_free(void *pp) {
+    if (pp == NULL || (uintptr_t)pp % 64 != 0) {
         abort();
+    }
+    sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_block *head = __atomic_load_n(&remote_frees, __ATOMIC_RELAXED);
+    do {
+        bp->body.links.next = head;
+    } while (!__atomic_compare_exchange_n(&remote_frees, &head, bp, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void sf_free_batch(void **pps, size_t n) {
+    size_t i;
+    if (n == 0) {
         return;
     }
-    // if invalid pointer is passed to function, must call "abort" to exit the program
+#ifdef SF_TRACE
+    for (i = 0; i < n; i++) {
+        SF_TRACE_EVENT(SF_OP_FREE, 0, 0, pps[i], NULL);
+    }
+#endif
+    if (!owns_heap()) {
+        // chain the blocks first, then hand over the whole chain with one CAS
+        sf_block *first = NULL, *last = NULL;
+        for (i = 0; i < n; i++) {
+            if (pps[i] == NULL || (uintptr_t)pps[i] % 64 != 0) {
+                abort();
+            }
+            sf_block *bp = (sf_block *)((void *)(pps[i]) - (sizeof(sf_header) + sizeof(sf_footer)));
+            bp->body.links.next = first;
+            first = bp;
+            if (last == NULL) {
+                last = bp;
+            }
+        }
+        sf_block *head = __atomic_load_n(&remote_frees, __ATOMIC_RELAXED);
+        do {
+            last->body.links.next = head;
+        } while (!__atomic_compare_exchange_n(&remote_frees, &head, first, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        return;
+    }
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    drain_on_entry();
+    for (i = 0; i < n; i++) {
+        free_user(pps[i]);
+    }
+    SF_PERF_LEAVE(SF_OP_FREE);
+    SF_HIST_LEAVE(SF_OP_FREE);
+    sf_heap_leave();
+}
+
+void sf_heap_claim(void) {
+    __atomic_store_n(&sf_owner, &sf_thread_tag, __ATOMIC_RELAXED);
+}
+
+size_t sf_heap_drain(void) {
+    if (!owns_heap()) {
+        return 0;
+    }
+    sf_heap_enter();
+    size_t n = drain_remote_frees();
+    sf_heap_leave();
+    return n;
+}
+
+static void cpu_relax(void) {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+void sf_heap_enter(void) {
+    if (heap_depth++ > 0 || !__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    int idle = 0;
+    if (!__atomic_compare_exchange_n(&heap_busy, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&owner_waiting, 1, __ATOMIC_RELAXED);
+        do {
+            while (__atomic_load_n(&heap_busy, __ATOMIC_RELAXED)) {
+                cpu_relax();
+            }
+            idle = 0;
+        } while (!__atomic_compare_exchange_n(&heap_busy, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+        __atomic_store_n(&owner_waiting, 0, __ATOMIC_RELAXED);
+    }
+    heap_held = 1;
+}
+
+void sf_heap_leave(void) {
+    if (--heap_depth > 0 || !heap_held) {
+        return;
+    }
+    heap_held = 0;
+    __atomic_store_n(&heap_busy, 0, __ATOMIC_RELEASE);
+}
+
+#define ASYNC_BATCH 32                  // blocks freed or carved per turn at the heap
+#define ASYNC_INTERVAL_NS 1000000       // 1 ms between rounds when not woken
+#define ASYNC_BACKOFF_NS 20000          // while the owner has the heap
+
+// the maintenance thread's side of heap_busy: never waits for the owner
+static int borrow_heap(void) {
+    int idle = 0;
+    return !__atomic_load_n(&owner_waiting, __ATOMIC_RELAXED)
+        && __atomic_compare_exchange_n(&heap_busy, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void return_heap(void) {
+    __atomic_store_n(&heap_busy, 0, __ATOMIC_RELEASE);
+}
+
+static int owner_wants_heap(void) {
+    return __atomic_load_n(&owner_waiting, __ATOMIC_RELAXED);
+}
+
+static void async_backoff(void) {
+    struct timespec ts = { 0, ASYNC_BACKOFF_NS };
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * Frees everything queued with sf_free_async, and whatever other threads have
+ * queued for the owner, a batch at a time.
+ *
+ * @return Nonzero if anything was freed.
+ */
+static int async_free_queued(void) {
+    sf_block *bp = __atomic_exchange_n(&async_frees, NULL, __ATOMIC_ACQUIRE);
+    int freed = 0;
+    while (bp != NULL || __atomic_load_n(&remote_frees, __ATOMIC_RELAXED) != NULL) {
+        if (!borrow_heap()) {
+            async_backoff();
+            continue;
+        }
+        freed |= drain_remote_frees() != 0;
+        int n;
+        for (n = 0; bp != NULL && n < ASYNC_BATCH && !owner_wants_heap(); n++) {
+            sf_block *next = bp->body.links.next;
+            free_user(bp->body.payload);
+            __atomic_sub_fetch(&async_pending, 1, __ATOMIC_RELAXED);
+            bp = next;
+            freed = 1;
+        }
+        return_heap();
+    }
+    return freed;
+}
+
+// gives the whole pages inside the wilderness back to the system
+static void discard_wilderness(void) {
+    sf_block *head = &sf_free_list_heads[NUM_FREE_LISTS-1];
+    sf_block *wild = head->body.links.next;
+    if (wild != head) {
+        sf_heap_discard((void *)wild->body.payload + FREE_BODY_USED, ftrp(wild));
+    }
+}
 
+// tops the sf_prefill blocks back up, a batch per round; trims if anything was freed
+static void async_tidy(int freed) {
+    if (sf_heap_start() == sf_heap_end() || !borrow_heap()) {
+        return; // next round
+    }
+    int n = 0, i;
+    for (i = 0; i < NUM_FREE_LISTS && n < ASYNC_BATCH; i++) {
+        prefill_stash *ps = &prefilled[i];
+        while (ps->count < ps->target && n < ASYNC_BATCH && !owner_wants_heap()) {
+            sf_block *bp = allocate_block(ps->asize, i);
+            if (bp == NULL) {
+                ps->target = ps->count; // out of memory, make do with what is there
+                break;
+            }
+            bp->body.links.next = ps->head;
+            ps->head = bp;
+            ps->count++;
+            n++;
+        }
+    }
+    if (freed && !rt_mode && !owner_wants_heap()) {
+        discard_wilderness();
+    }
+    return_heap();
+}
+
+static void *async_main(void *arg) {
+    while (!__atomic_load_n(&async_stopping, __ATOMIC_ACQUIRE)) {
+        async_tidy(async_free_queued());
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += ASYNC_INTERVAL_NS;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&async_lock);
+        if (!__atomic_load_n(&async_stopping, __ATOMIC_ACQUIRE)
+            && __atomic_load_n(&async_pending, __ATOMIC_RELAXED) < async_max_pending / 2) {
+            pthread_cond_timedwait(&async_wake, &async_lock, &until);
+        }
+        pthread_mutex_unlock(&async_lock);
+    }
+    return NULL;
+}
+
+int sf_free_async_start(size_t max_pending) {
+    if (!owns_heap()) {
+        sf_errno = EPERM;
+        return -1;
+    }
+    if (async_running) {
+        sf_errno = EBUSY;
+        return -1;
+    }
+    async_max_pending = max_pending != 0 ? max_pending : SF_ASYNC_MAX_PENDING;
+    async_stopping = 0;
+    heap_busy = 0;
+    owner_waiting = 0;
+    __atomic_store_n(&async_running, 1, __ATOMIC_RELEASE);
+    int err = pthread_create(&async_thread, NULL, async_main, NULL);
+    if (err != 0) {
+        __atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+        sf_errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void sf_free_async(void *pp) {
+    if (!__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        sf_free(pp);
+        return;
+    }
+    if (__atomic_load_n(&async_pending, __ATOMIC_RELAXED) >= async_max_pending) {
+        // the thread is behind: the caller frees it, as it would have without us
+        pthread_cond_signal(&async_wake);
+        sf_free(pp);
+        return;
+    }
+    SF_TRACE_EVENT(SF_OP_FREE, 0, 0, pp, NULL);
+    if (pp == NULL || (uintptr_t)pp % 64 != 0) {
+        abort();
+    }
+    sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
+    size_t pending = __atomic_add_fetch(&async_pending, 1, __ATOMIC_RELAXED);
+    sf_block *head = __atomic_load_n(&async_frees, __ATOMIC_RELAXED);
+    do {
+        bp->body.links.next = head;
+    } while (!__atomic_compare_exchange_n(&async_frees, &head, bp, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (pending == async_max_pending / 2 + 1) {
+        pthread_cond_signal(&async_wake);
+    }
+}
+
+int sf_free_async_stop(void) {
+    if (!async_running || !owns_heap()) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&async_lock);
+    __atomic_store_n(&async_stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&async_wake);
+    pthread_mutex_unlock(&async_lock);
+    pthread_join(async_thread, NULL);
+    __atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+
+    // whatever came in after the thread's last round
+    sf_block *bp = __atomic_exchange_n(&async_frees, NULL, __ATOMIC_ACQUIRE);
+    while (bp != NULL) {
+        sf_block *next = bp->body.links.next;
+        free_user(bp->body.payload);
+        bp = next;
+    }
+    __atomic_store_n(&async_pending, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+size_t sf_free_async_pending(void) {
+    return __atomic_load_n(&async_pending, __ATOMIC_RELAXED);
+}
+
+void *sf_malloc(size_t size) {
+    return sf_malloc_tagged(size, sf_current_tag);
+}
+
+void *sf_malloc_tagged(size_t size, int tag) {
+    if (tag < 0 || tag >= SF_MAX_TAGS) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    if (SF_GUARD_SAMPLE()) {
+        void *gp = sf_guard_malloc(size, tag);
+        if (gp != NULL) {
+            SF_TRACE_EVENT(SF_OP_MALLOC, size, 0, gp, NULL);
+            return gp;
+        }
+    }
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    drain_on_entry();
+    void *pp = do_malloc(size);
+    if (pp != NULL) {
+        sf_tag_alloc((sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer))), tag);
+    }
+    SF_PERF_LEAVE(SF_OP_MALLOC);
+    SF_HIST_LEAVE(SF_OP_MALLOC);
+    sf_heap_leave();
+    SF_TRACE_EVENT(SF_OP_MALLOC, size, 0, pp, NULL);
+    if (soft_pending && !in_pressure) {
+        soft_pending = 0;
+        run_pressure_callbacks(SF_PRESSURE_SOFT);
+    }
+    return pp;
+}
+
+void *sf_malloc_class(size_t asize, int index) {
+    if (SF_GUARD_SAMPLE()) {
+        void *gp = sf_guard_malloc(asize - sizeof(sf_header), sf_current_tag);
+        if (gp != NULL) {
+            SF_TRACE_EVENT(SF_OP_MALLOC, asize - sizeof(sf_header), 0, gp, NULL);
+            return gp;
+        }
+    }
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    drain_on_entry();
+    void *pp = malloc_block(asize, index);
+    if (pp != NULL) {
+        sf_tag_alloc((sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer))), sf_current_tag);
+    }
+    SF_PERF_LEAVE(SF_OP_MALLOC);
+    SF_HIST_LEAVE(SF_OP_MALLOC);
+    sf_heap_leave();
+    SF_TRACE_EVENT(SF_OP_MALLOC, asize - sizeof(sf_header), 0, pp, NULL);
+    if (soft_pending && !in_pressure) {
+        soft_pending = 0;
+        run_pressure_callbacks(SF_PRESSURE_SOFT);
+    }
+    return pp;
+}
+
+// bp has been checked with valid_pointer
+static void free_block(sf_block *bp) {
     // after confirming that a valid pointer was given, you must free the block
     // first, the block must be coalesced with any adjacent free block
     // then, determine the class size appropriate for the (now-coalescede) block
@@ -499,7 +1234,6 @@ void sf_free(void *pp) {
 
     // free block
     // prev_footer is the same
-    sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
     bp->header = bp->header & ~(THIS_BLOCK_ALLOCATED); // make bit not allocated
     sf_block *footer = ftrp(bp); // footer
     footer->header = bp->header;
@@ -518,7 +1252,103 @@ void sf_free(void *pp) {
     return;
 }
 
-void *sf_realloc(void *pp, size_t rsize) {
+static void do_free(void *pp) {
+    // pointer address in int = (sf_block *)((void *)(pointer))
+
+    // verify that the pointer being pass belongs to an allocated block
+    // examining the fields of the block header and footer
+
+    if (!valid_pointer(pp)) {
+        abort();
+        return;
+    }
+    // if invalid pointer is passed to function, must call "abort" to exit the program
+    free_block((sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer))));
+}
+
+// a block the application is done with: also comes off its tag's count
+static void free_user(void *pp) {
+    if (SF_GUARD_OWNS(pp)) {
+        sf_guard_free(pp);
+        return;
+    }
+    if (!valid_pointer(pp)) {
+        abort();
+    }
+    sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_tag_free(bp);
+    free_block(bp);
+}
+
+void sf_free(void *pp) {
+    SF_TRACE_EVENT(SF_OP_FREE, 0, 0, pp, NULL);
+    if (SF_GUARD_OWNS(pp)) {
+        sf_guard_free(pp); // from any thread, the pool has its own lock
+        return;
+    }
+    if (!owns_heap()) {
+        remote_free(pp);
+        return;
+    }
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    drain_on_entry();
+    free_user(pp);
+    SF_PERF_LEAVE(SF_OP_FREE);
+    SF_HIST_LEAVE(SF_OP_FREE);
+    sf_heap_leave();
+}
+
+/*
+ * Grows the allocated block bp to asize bytes where it is, by taking space from
+ * the free block after it, growing the heap first if bp is the last block before
+ * the wilderness or the epilogue.  Nothing is copied and new pages are only
+ * touched when written.
+ *
+ * @return Nonzero if bp now holds asize bytes; zero, with the heap unchanged
+ * apart from any pages it grew by, if it could not be done.
+ */
+static int grow_in_place(sf_block *bp, size_t asize) {
+    size_t have = get_size(bp);
+    sf_block *next = next_blockp(bp);
+    size_t room = get_alloc(next) ? 0 : get_size(next);
+    int last = get_alloc(next) ? get_size(next) == 0 : is_wilderness(next);
+    if (have + room < asize) {
+        if (!last) {
+            return 0;
+        }
+        int saved_errno = sf_errno;
+        if (grow_wilderness(asize - have) == NULL) {
+            sf_errno = saved_errno; // sf_realloc still gets to try moving the block
+            return 0;
+        }
+        next = next_blockp(bp);
+    }
+
+    int took_wilderness = is_wilderness(next);
+    remove_free_block(next);
+    sf_pagemap_clear(next);
+    size_t size = have + get_size(next);
+    bp->header = (size & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | get_prev_alloc(bp);
+    sf_block *after = next_blockp(bp);
+    after->header = after->header | PREV_BLOCK_ALLOCATED;
+    split(bp, asize);
+    if (took_wilderness) {
+        // the block now covers what used to be the start of the wilderness
+        void *clean = is_wilderness(bp) ? sf_heap_end()
+                    : (void *)((sf_block *)next_blockp(bp))->body.payload + FREE_BODY_USED;
+        if (sf_clean_start < clean) {
+            sf_clean_start = clean;
+        }
+    }
+    return 1;
+}
+
+// a free block of at least this many bytes left by shrinking a block gives its pages back
+#define DISCARD_MIN (16 * PAGE_SZ)
+
+static void *do_realloc(void *pp, size_t rsize) {
     // rsize is size of the payload
     // check if valid pointer
     if (!valid_pointer(pp)) {
@@ -528,7 +1358,11 @@ void *sf_realloc(void *pp, size_t rsize) {
     // check if valid size (valid pointer)
     if (rsize == 0) {
         // free the block and return null
-        sf_free(pp);
+        do_free(pp);
+        return NULL;
+    }
+    if (rsize > MAX_REQUEST) {
+        sf_errno = ENOMEM; // the block is left as it was
         return NULL;
     }
 
@@ -541,23 +1375,33 @@ void *sf_realloc(void *pp, size_t rsize) {
         asize = 64;
     }
 
-    if (get_size(bp) == (rsize + sizeof(sf_header))) {
+    // still rounds up to the same block: the slack already covers it
+    if (get_size(bp) == asize) {
         return bp->body.payload;
     }
 
     // reallocating to a larger size
     if (get_size(bp) < (rsize + sizeof(sf_header))) {
+        // multi-page blocks grow where they are if they can, copying is what costs
+        if ((get_size(bp) >= PAGE_SZ || rt_mode) && grow_in_place(bp, asize)) {
+            return bp->body.payload;
+        }
+        if (rt_mode) {
+            sf_errno = ENOMEM; // moving would copy the whole payload
+            return NULL;
+        }
         // call sf_malloc to obtain a larger block
-        void *dest = sf_malloc(rsize); // malloc returns pointer to region of mem
+        void *dest = do_malloc(rsize); // malloc returns pointer to region of mem
         // if no memory available, malloc set sf_errno = ENOMEM
         if (dest == NULL) {
             // if sf_malloc returns NULL, then sf_realloc must also return NULL
             return NULL;
         }
-        // call memcpy to copy the data in the block given by the client to the block returned by sf_malloc
+        // copy the data in the block given by the client to the block returned by sf_malloc
             // copy the entire payload area, but no more
-        memcpy(dest, pp, rsize);
-        sf_free(pp);
+        sf_copy(dest, pp, get_size(bp) - sizeof(sf_header));
+        SF_HIST_NOTE(SF_EV_COPY);
+        do_free(pp);
         return dest;
     } else { // reallocating to a smaller size
 
@@ -569,13 +1413,73 @@ void *sf_realloc(void *pp, size_t rsize) {
             // if splinter, do not split, leave splinter in the block
             // updated the header
         split(bp, asize);
+        sf_block *rest = next_blockp(bp);
+        if (!rt_mode && !get_alloc(rest) && get_size(rest) >= DISCARD_MIN) {
+            // keep the links and footer, drop the pages in between
+            sf_heap_discard((void *)rest->body.payload + FREE_BODY_USED, ftrp(rest));
+        }
         return bp->body.payload;
     }
 
     return NULL;
 }
 
-void *sf_memalign(size_t size, size_t align) {
+// a guarded block always moves, to a heap block
+static void *guard_realloc(void *pp, size_t rsize) {
+    size_t have = sf_guard_usable_size(pp);
+    if (have == 0) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    if (rsize == 0) {
+        sf_guard_free(pp);
+        return NULL;
+    }
+    int tag = sf_guard_tag(pp);
+    sf_heap_enter();
+    drain_on_entry();
+    void *dest = do_malloc(rsize);
+    if (dest != NULL) {
+        sf_tag_alloc((sf_block *)((void *)(dest) - (sizeof(sf_header) + sizeof(sf_footer))), tag);
+    }
+    sf_heap_leave();
+    if (dest == NULL) {
+        return NULL;
+    }
+    sf_copy(dest, pp, have < rsize ? have : rsize);
+    sf_guard_free(pp);
+    return dest;
+}
+
+void *sf_realloc(void *pp, size_t rsize) {
+    if (SF_GUARD_OWNS(pp)) {
+        void *dest = guard_realloc(pp, rsize);
+        SF_TRACE_EVENT(SF_OP_REALLOC, rsize, 0, dest, pp);
+        return dest;
+    }
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    // the block keeps its tag wherever it ends up
+    int tag = -1;
+    sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
+    if (valid_pointer(pp)) {
+        tag = sf_tag_free(bp);
+    }
+    void *dest = do_realloc(pp, rsize);
+    if (dest != NULL) {
+        sf_tag_alloc((sf_block *)((void *)(dest) - (sizeof(sf_header) + sizeof(sf_footer))), tag);
+    } else if (tag >= 0 && rsize != 0) {
+        sf_tag_alloc(bp, tag); // could not grow it, pp is unchanged
+    }
+    SF_PERF_LEAVE(SF_OP_REALLOC);
+    SF_HIST_LEAVE(SF_OP_REALLOC);
+    sf_heap_leave();
+    SF_TRACE_EVENT(SF_OP_REALLOC, rsize, 0, dest, pp);
+    return dest;
+}
+
+static void *do_memalign(size_t size, size_t align) {
     // check that the requested alignment is at least as large as the minimum block size
     // check that the requested alignment is a power of two
     // if fail, sf_errno = EINVAL, return null
@@ -586,6 +1490,10 @@ void *sf_memalign(size_t size, size_t align) {
     }
 
     // check passed
+    if (size > MAX_REQUEST || align > MAX_REQUEST - size) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
 
     // aligned to 64-byte boundaries
     size_t block_size = size + sizeof(sf_header); // Adjust block size
@@ -597,12 +1505,15 @@ void *sf_memalign(size_t size, size_t align) {
         block_size = 64;
     }
 
-    //sf_block *prologue = (sf_block *)((void *)sf_mem_start() + (sizeof(sf_header) * 6)); // 48
+    //sf_block *prologue = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // 48
     //sf_block *prologue_end = ftrp(prologue) + sizeof(sf_footer);
     //sf_block *start_payload_ptr = (void *)prologue_end + (sizeof(sf_header) *2);
 
     size_t asize = size + align + 64 + sizeof(sf_header);
-    void *payload_ptr = sf_malloc(asize);
+    void *payload_ptr = do_malloc(asize);
+    if (payload_ptr == NULL) { // do_malloc has set sf_errno to ENOMEM
+        return NULL;
+    }
     sf_block *bp = payload_ptr - (sizeof(sf_header) * 2);
     size_t osize = get_size(bp);
     sf_block *new_bp = bp;
@@ -639,6 +1550,7 @@ void *sf_memalign(size_t size, size_t align) {
             int index = free_list_index(prev_size);
             add_free_list(index, bp);
             new_bp->header = ((osize - prev_size) & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED;
+            sf_pagemap_set(new_bp);
         } else {
             if (get_prev_alloc(new_bp)) {
                 new_bp->header = ((osize - prev_size) & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
@@ -660,3 +1572,278 @@ void *sf_memalign(size_t size, size_t align) {
     return new_bp->body.payload;
 }
 
+void *sf_memalign(size_t size, size_t align) {
+    sf_heap_enter();
+    SF_HIST_ENTER();
+    SF_PERF_ENTER();
+    void *pp = do_memalign(size, align);
+    if (pp != NULL) {
+        sf_tag_alloc((sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer))), sf_current_tag);
+    }
+    SF_PERF_LEAVE(SF_OP_MEMALIGN);
+    SF_HIST_LEAVE(SF_OP_MEMALIGN);
+    sf_heap_leave();
+    SF_TRACE_EVENT(SF_OP_MEMALIGN, size, align, pp, NULL);
+    return pp;
+}
+
+size_t sf_malloc_usable_size(void *pp) {
+    if (SF_GUARD_OWNS(pp)) {
+        return sf_guard_usable_size(pp);
+    }
+    if (pp == NULL) {
+        return 0;
+    }
+    // the headers valid_pointer reads can change under the maintenance thread too
+    sf_heap_enter();
+    size_t size = 0;
+    if (valid_pointer(pp)) {
+        // an allocated block has no footer, its payload runs up to the next header
+        sf_block *bp = (sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer)));
+        size = get_size(bp) - sizeof(sf_header);
+    }
+    sf_heap_leave();
+    return size;
+}
+
+void *sf_malloc_at_least(size_t size, size_t *actual) {
+    void *pp = sf_malloc(size);
+    if (actual != NULL) {
+        *actual = pp == NULL ? 0 : sf_malloc_usable_size(pp);
+    }
+    return pp;
+}
+
+void *sf_calloc(size_t nmemb, size_t size) {
+    if (nmemb == 0 || size == 0) {
+        return NULL;
+    }
+    if (size > SIZE_MAX / nmemb) { // nmemb * size overflows
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    size_t total = nmemb * size;
+
+    // held until the zeroing is done, so the clean run cannot change under it
+    sf_heap_enter();
+    void *pp = sf_malloc(total);
+    if (pp == NULL || SF_GUARD_OWNS(pp)) {
+        sf_heap_leave(); // guarded slots are handed out zero-filled
+        return pp;
+    }
+    // the clean run as it was when the block was placed, after any growth
+    void *clean_start = sf_placed_clean_start;
+    void *clean_end = sf_heap_end() - (sizeof(sf_header) + sizeof(sf_footer));
+
+    // placing the block may have written the next block's prev_footer into the last row
+    sf_block *bp = (sf_block *)((void *)pp - (sizeof(sf_header) + sizeof(sf_footer)));
+    void *last_row = (void *)next_blockp(bp);
+    if (clean_end > last_row) {
+        clean_end = last_row;
+    }
+
+    void *end = pp + total;
+    void *lo = clean_start > pp ? clean_start : pp;
+    void *hi = clean_end < end ? clean_end : end;
+    if (lo >= hi) {
+        sf_zero(pp, total);
+    } else {
+        sf_zero(pp, lo - pp);
+        sf_zero(hi, end - hi);
+    }
+    sf_heap_leave();
+    return pp;
+}
+
+static int reserve(size_t bytes) {
+    if (sf_heap_start() == sf_heap_end()) {
+        if (sf_init() < 0) {
+            return -1;
+        }
+    }
+    if (bytes > SIZE_MAX - 128) {
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    size_t asize = block_size(bytes);
+    sf_block *wild = sf_free_list_heads[NUM_FREE_LISTS-1].body.links.next;
+    if (wild == &sf_free_list_heads[NUM_FREE_LISTS-1] || get_size(wild) < asize) {
+        wild = grow_wilderness(asize);
+        if (wild == NULL) {
+            return -1;
+        }
+    }
+
+    // fault in every page of the wilderness now; rewriting a byte with itself leaves
+    // the contents, and the clean run, as they were
+    volatile char *p = (volatile char *)wild->body.payload + FREE_BODY_USED;
+    volatile char *end = (volatile char *)ftrp(wild);
+    for (; p < end; p += PAGE_SZ) {
+        *p = *p;
+    }
+    return 0;
+}
+
+int sf_reserve(size_t bytes) {
+    sf_heap_enter();
+    int ret = reserve(bytes);
+    sf_heap_leave();
+    return ret;
+}
+
+static size_t prefill(size_t size, size_t count) {
+    if (size == 0 || count == 0) {
+        return 0;
+    }
+    if (sf_heap_start() == sf_heap_end()) {
+        if (sf_init() < 0) {
+            return 0;
+        }
+    }
+    size_t asize = block_size(size);
+    int index = free_list_index(asize);
+    prefill_stash *ps = &prefilled[index];
+    if (ps->head != NULL && ps->asize != asize) {
+        // one size per class: give back what was set aside for the old one
+        while (ps->head != NULL) {
+            sf_block *bp = ps->head;
+            ps->head = bp->body.links.next;
+            do_free(bp->body.payload);
+        }
+        ps->count = 0;
+    }
+    ps->asize = asize;
+
+    // grow once up front, so the blocks come out of one run of the wilderness
+    if (count <= SIZE_MAX / asize) {
+        reserve(count * asize);
+    }
+    size_t n;
+    for (n = 0; n < count; n++) {
+        sf_block *bp = allocate_block(asize, index);
+        if (bp == NULL) {
+            break;
+        }
+        bp->body.links.next = ps->head;
+        ps->head = bp;
+        ps->count++;
+    }
+    ps->target = ps->count;
+    return n;
+}
+
+size_t sf_prefill(size_t size, size_t count) {
+    sf_heap_enter();
+    size_t n = prefill(size, count);
+    sf_heap_leave();
+    return n;
+}
+
+// gives back every block sf_prefill set aside, and stops them being topped up
+static void flush_prefilled(void) {
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        while (prefilled[i].head != NULL) {
+            sf_block *bp = prefilled[i].head;
+            prefilled[i].head = bp->body.links.next;
+            do_free(bp->body.payload);
+        }
+        prefilled[i].count = 0;
+        prefilled[i].target = 0;
+    }
+}
+
+// gives the whole pages inside every free block back to the system
+static size_t discard_free_pages(void) {
+    size_t n = 0;
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        sf_block *head = &sf_free_list_heads[i];
+        sf_block *bp;
+        for (bp = head->body.links.next; bp != head; bp = bp->body.links.next) {
+            n += sf_heap_discard((void *)bp->body.payload + FREE_BODY_USED, ftrp(bp));
+        }
+    }
+    return n;
+}
+
+size_t sf_trim(void) {
+    if (!owns_heap() || sf_heap_start() == sf_heap_end() || rt_mode) {
+        return 0;
+    }
+    sf_heap_enter();
+    drain_remote_frees();
+    flush_prefilled();
+    size_t n = discard_free_pages();
+    sf_heap_leave();
+    return n;
+}
+
+int sf_set_limit(size_t soft, size_t hard) {
+    if (hard != 0 && soft > hard) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    soft_limit = soft;
+    hard_limit = hard;
+    soft_crossed = 0;
+    soft_pending = 0;
+    if (sf_heap_start() != sf_heap_end()) {
+        note_heap_size(); // already past it: tell the callbacks at the next sf_malloc
+    }
+    return 0;
+}
+
+int sf_add_pressure_callback(sf_pressure_fn fn, void *arg) {
+    int i;
+    if (fn == NULL) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < SF_MAX_PRESSURE_CALLBACKS; i++) {
+        if (pressure_callbacks[i].fn == NULL) {
+            pressure_callbacks[i].fn = fn;
+            pressure_callbacks[i].arg = arg;
+            return 0;
+        }
+    }
+    sf_errno = ENOMEM;
+    return -1;
+}
+
+int sf_remove_pressure_callback(sf_pressure_fn fn, void *arg) {
+    int i;
+    for (i = 0; i < SF_MAX_PRESSURE_CALLBACKS; i++) {
+        if (pressure_callbacks[i].fn == fn && pressure_callbacks[i].arg == arg) {
+            pressure_callbacks[i].fn = NULL;
+            pressure_callbacks[i].arg = NULL;
+            return 0;
+        }
+    }
+    sf_errno = EINVAL;
+    return -1;
+}
+
+int sf_rt_init(size_t bytes) {
+    if (sf_heap_start() != sf_heap_end()) {
+        sf_errno = EBUSY;
+        return -1;
+    }
+    if (sf_init() < 0 || reserve(bytes) < 0) {
+        return -1;
+    }
+    if (sf_pagemap_reserve() < 0) {
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    // the index's side arrays grow with realloc; the bounded search does not need them
+    fit_index_ok = 0;
+    rt_mode = 1;
+    // a sampled allocation makes system calls, which the bound cannot allow for
+    sf_guard_stop();
+    return 0;
+}
+
+int sf_rt_active(void) {
+    return rt_mode;
+}
@@ -0,0 +1,267 @@
+/**
+ * Position-independent heaps: sfmm blocks with offset-linked free lists.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfoheap.h"
+
+#define OFFSET(h, p) ((uint64_t)((void *)(p) - (void *)(h)))
+#define BLOCK_AT(h, off) ((sf_block *)((void *)(h) + (off)))
+
+// padding, then a 64-byte prologue, as in the sfmm heap
+static sf_block *prologue(sf_oheap *h) {
+    return (sf_block *)((void *)h + SF_OHEAP_START + (sizeof(sf_header) * 6)); // 48
+}
+
+static sf_block *first_block(sf_oheap *h) {
+    return (sf_block *)((void *)prologue(h) + 64);
+}
+
+static sf_block *epilogue(sf_oheap *h) {
+    return (sf_block *)((void *)h + h->size - (sizeof(sf_header) + sizeof(sf_footer)));
+}
+
+// the link rows of a free block hold offsets instead of pointers
+static uint64_t *link_next(sf_block *bp) {
+    return (uint64_t *)bp->body.payload;
+}
+
+static uint64_t *link_prev(sf_block *bp) {
+    return (uint64_t *)bp->body.payload + 1;
+}
+
+// the block in front of the epilogue goes on the last list, as the wilderness does in sfmm
+static int list_for(sf_oheap *h, sf_block *bp) {
+    if (next_blockp(bp) == (void *)epilogue(h)) {
+        return NUM_FREE_LISTS - 1;
+    }
+    return free_list_index(get_size(bp));
+}
+
+static void link_block(sf_oheap *h, sf_block *bp) {
+    int i = list_for(h, bp);
+    uint64_t off = OFFSET(h, bp);
+    *link_next(bp) = h->heads[i];
+    *link_prev(bp) = 0;
+    if (h->heads[i] != 0) {
+        *link_prev(BLOCK_AT(h, h->heads[i])) = off;
+    }
+    h->heads[i] = off;
+}
+
+static void unlink_block(sf_oheap *h, sf_block *bp) {
+    uint64_t off = OFFSET(h, bp);
+    uint64_t next = *link_next(bp);
+    uint64_t prev = *link_prev(bp);
+    if (next != 0) {
+        *link_prev(BLOCK_AT(h, next)) = prev;
+    }
+    if (prev != 0) {
+        *link_next(BLOCK_AT(h, prev)) = next;
+        return;
+    }
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        if (h->heads[i] == off) {
+            h->heads[i] = next;
+        }
+    }
+}
+
+int sf_oheap_format(sf_oheap *h, size_t size, int dirty) {
+    if (size < SF_OHEAP_MIN_SIZE || size % 64 != 0 || size > BLOCK_SIZE_MASK) {
+        return -1;
+    }
+    h->magic = 0;
+    h->dirty = dirty != 0;
+    h->size = size;
+    h->root = 0;
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        h->heads[i] = 0;
+    }
+
+    sf_block *pro = prologue(h);
+    pro->header = (64 & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED | THIS_BLOCK_ALLOCATED;
+    sf_block *bp = first_block(h);
+    bp->prev_footer = pro->header;
+    size_t bsize = (void *)epilogue(h) - (void *)bp;
+    bp->header = (bsize & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
+    sf_block *epi = epilogue(h);
+    epi->prev_footer = bp->header;
+    epi->header = (0 & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED;
+    link_block(h, bp);
+    // last, so a process mapping the heap meanwhile does not take it for finished;
+    // until magic is set it cannot tell a heap being formatted from an empty one
+    h->version = SF_OHEAP_VERSION;
+    __atomic_store_n(&h->magic, SF_OHEAP_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sf_oheap_valid(sf_oheap *h, size_t size) {
+    return __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == SF_OHEAP_MAGIC
+        && h->version == SF_OHEAP_VERSION && h->size == size;
+}
+
+// nonzero if pp is the payload of an allocated block of h
+static int valid_block(sf_oheap *h, void *pp) {
+    if (pp == NULL) {
+        return 0;
+    }
+    sf_block *bp = (sf_block *)(pp - (sizeof(sf_header) + sizeof(sf_footer)));
+    if (OFFSET(h, pp) % 64 != 0 || bp < first_block(h) || bp >= epilogue(h)) {
+        return 0;
+    }
+    size_t size = get_size(bp);
+    if (!get_alloc(bp) || size < 64 || size % 64 != 0 || (void *)bp + size > (void *)epilogue(h)) {
+        return 0;
+    }
+    if (!get_prev_alloc(bp)) {
+        sf_block *prev = prev_blockp(bp);
+        if (prev < first_block(h) || get_alloc(prev)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sf_oheap_rebuild(sf_oheap *h) {
+    int i;
+    for (i = 0; i < NUM_FREE_LISTS; i++) {
+        h->heads[i] = 0;
+    }
+    sf_block *end = epilogue(h);
+    sf_block *bp = first_block(h);
+    size_t prev_alloc = PREV_BLOCK_ALLOCATED; // prologue
+    while (bp < end) {
+        size_t size = get_size(bp);
+        if (size < 64 || size % 64 != 0 || (void *)bp + size > (void *)end) {
+            return -1;
+        }
+        sf_block *next = (sf_block *)((void *)bp + size);
+        if (get_alloc(bp)) {
+            bp->header = (size & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | prev_alloc;
+            prev_alloc = PREV_BLOCK_ALLOCATED;
+            bp = next;
+            continue;
+        }
+        // a crash between freeing a block and merging it leaves free neighbours behind
+        while (next < end && !get_alloc(next)) {
+            size_t nsize = get_size(next);
+            if (nsize < 64 || nsize % 64 != 0 || (void *)next + nsize > (void *)end) {
+                return -1;
+            }
+            size += nsize;
+            next = (sf_block *)((void *)next + nsize);
+        }
+        bp->header = (size & BLOCK_SIZE_MASK) | prev_alloc;
+        next->prev_footer = bp->header;
+        link_block(h, bp);
+        prev_alloc = 0;
+        bp = next;
+    }
+    if (bp != end) {
+        return -1;
+    }
+    end->header = (0 & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | prev_alloc;
+    if (h->root != 0 && (h->root >= h->size || !valid_block(h, BLOCK_AT(h, h->root)))) {
+        h->root = 0;
+    }
+    return 0;
+}
+
+/*
+ * Updates are ordered so that the chain of block headers is whole after every
+ * single store: the parts a split or merge creates are written first, and the
+ * header that makes the walk see them is written last.  A crash at any point
+ * therefore leaves headers that sf_oheap_rebuild can work from, whatever state
+ * the free lists were left in.
+ */
+
+void *sf_oheap_malloc(sf_oheap *h, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > h->size) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    size_t asize = size + sizeof(sf_header); // Adjust block size
+    if (asize % 64 != 0) {
+        asize = ((asize/64) + 1) * 64;
+    }
+
+    sf_block *bp = NULL;
+    int i;
+    for (i = free_list_index(asize); i < NUM_FREE_LISTS && bp == NULL; i++) {
+        uint64_t off;
+        for (off = h->heads[i]; off != 0; off = *link_next(BLOCK_AT(h, off))) {
+            if (get_size(BLOCK_AT(h, off)) >= asize) {
+                bp = BLOCK_AT(h, off);
+                break;
+            }
+        }
+    }
+    if (bp == NULL) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    unlink_block(h, bp);
+    size_t bsize = get_size(bp);
+    size_t prev_alloc = get_prev_alloc(bp);
+    if (bsize - asize >= 64) {
+        // split, the upper part stays free
+        sf_block *upper = (sf_block *)((void *)bp + asize);
+        upper->header = ((bsize - asize) & BLOCK_SIZE_MASK) | PREV_BLOCK_ALLOCATED;
+        sf_block *footer = ftrp(upper);
+        footer->header = upper->header;
+        bp->header = (asize & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | prev_alloc;
+        link_block(h, upper);
+    } else {
+        bp->header = (bsize & BLOCK_SIZE_MASK) | THIS_BLOCK_ALLOCATED | prev_alloc;
+        sf_block *next = next_blockp(bp);
+        next->header = next->header | PREV_BLOCK_ALLOCATED;
+    }
+    return bp->body.payload;
+}
+
+void sf_oheap_free(sf_oheap *h, void *pp) {
+    if (!valid_block(h, pp)) {
+        abort();
+        return;
+    }
+    sf_block *bp = (sf_block *)(pp - (sizeof(sf_header) + sizeof(sf_footer)));
+    sf_block *start = bp;
+    size_t size = get_size(bp);
+
+    sf_block *next = next_blockp(bp);
+    if (!get_alloc(next)) {
+        unlink_block(h, next);
+        size += get_size(next);
+    }
+    if (!get_prev_alloc(bp)) {
+        start = prev_blockp(bp);
+        unlink_block(h, start);
+        size += get_size(start);
+    }
+
+    size_t header = (size & BLOCK_SIZE_MASK) | get_prev_alloc(start);
+    sf_block *after = (sf_block *)((void *)start + size);
+    after->prev_footer = header; // footer of the merged block
+    start->header = header;
+    after->header = after->header & ~(PREV_BLOCK_ALLOCATED);
+    link_block(h, start);
+}
+
+uint64_t sf_oheap_offset(sf_oheap *h, void *pp) {
+    return pp == NULL ? 0 : OFFSET(h, pp);
+}
+
+void *sf_oheap_at(sf_oheap *h, uint64_t offset) {
+    return offset == 0 ? NULL : (void *)h + offset;
+}
@@ -0,0 +1,228 @@
+/**
+ * Page providers: where heap pages come from.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfpage.h"
+
+#define HUGE_PAGE_SZ (2UL << 20)
+
+/* sfutil */
+
+static int sfutil_init(size_t reserve) {
+    sf_mem_init();
+    return 0;
+}
+
+static void sfutil_fini(void) {
+    sf_mem_fini();
+}
+
+const sf_page_provider sf_sfutil_pages = {
+    "sfutil", sfutil_init, sfutil_fini, sf_mem_grow, sf_mem_start, sf_mem_end, 0, NULL
+};
+
+/* mmap reserve and commit, shared by the mmap and huge page providers */
+
+static char *map_base = NULL;       // what munmap has to release
+static size_t map_len = 0;
+static char *region_start = NULL;   // heap start, aligned to commit_unit
+static char *region_limit = NULL;   // end of the reservation
+static char *region_end = NULL;     // end of the heap
+static char *region_committed = NULL;
+static size_t commit_unit = PAGE_SZ;
+static const char *region_backing = "mmap";
+static const char hugetlb_backing[] = "hugetlb";
+
+static void region_fini(void) {
+    if (map_base != NULL) {
+        munmap(map_base, map_len);
+    }
+    map_base = NULL;
+    map_len = 0;
+    region_start = region_limit = region_end = region_committed = NULL;
+}
+
+// reserves inaccessible address space, aligned to align
+static int region_reserve(size_t reserve, size_t align) {
+    reserve = (reserve + align - 1) & ~(align - 1);
+    map_len = reserve + align;
+    map_base = mmap(NULL, map_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_base == MAP_FAILED) {
+        map_base = NULL;
+        return -1;
+    }
+    region_start = (char *)(((uintptr_t)map_base + align - 1) & ~(uintptr_t)(align - 1));
+    region_limit = region_start + reserve;
+    region_end = region_committed = region_start;
+    return 0;
+}
+
+static void *region_grow(void) {
+    if (region_end + PAGE_SZ > region_limit) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    if (region_end + PAGE_SZ > region_committed) {
+        // commit a whole unit; its pages arrive zero-filled
+        if (mprotect(region_committed, commit_unit, PROT_READ | PROT_WRITE) != 0) {
+            sf_errno = ENOMEM;
+            return NULL;
+        }
+        region_committed += commit_unit;
+    }
+    void *page = region_end;
+    region_end += PAGE_SZ;
+    return page;
+}
+
+static void *region_start_addr(void) {
+    return region_start;
+}
+
+static void *region_end_addr(void) {
+    return region_end;
+}
+
+static size_t region_discard(void *start, size_t len) {
+    char *lo = start, *hi = lo + len;
+    if (region_backing == hugetlb_backing) {
+        // a hugetlb mapping can only drop whole huge pages
+        lo = (char *)(((uintptr_t)lo + HUGE_PAGE_SZ - 1) & ~(uintptr_t)(HUGE_PAGE_SZ - 1));
+        hi = (char *)((uintptr_t)hi & ~(uintptr_t)(HUGE_PAGE_SZ - 1));
+        if (lo >= hi) {
+            return 0;
+        }
+    }
+    // private anonymous pages read back as zeros once dropped
+    if (madvise(lo, hi - lo, MADV_DONTNEED) != 0) {
+        return 0;
+    }
+    return hi - lo;
+}
+
+static int mmap_init(size_t reserve) {
+    region_fini();
+    commit_unit = PAGE_SZ;
+    region_backing = "mmap";
+    return region_reserve(reserve, PAGE_SZ);
+}
+
+const sf_page_provider sf_mmap_pages = {
+    "mmap", mmap_init, region_fini, region_grow, region_start_addr, region_end_addr, 1, region_discard
+};
+
+static int hugepage_init(size_t reserve) {
+    region_fini();
+    commit_unit = HUGE_PAGE_SZ;
+    reserve = (reserve + HUGE_PAGE_SZ - 1) & ~(HUGE_PAGE_SZ - 1);
+#ifdef MAP_HUGETLB
+    // hugetlb pages cannot be committed piecemeal, so map the whole reservation;
+    // without MAP_NORESERVE this fails up front, not with SIGBUS later, if the pool is short
+    map_base = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (map_base != MAP_FAILED) {
+        map_len = reserve;
+        region_start = region_end = map_base;
+        region_limit = region_committed = map_base + reserve;
+        region_backing = hugetlb_backing;
+        return 0;
+    }
+    map_base = NULL;
+#endif
+    // no huge pages reserved on this system: fall back to transparent huge pages
+    if (region_reserve(reserve, HUGE_PAGE_SZ) < 0) {
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(region_start, reserve, MADV_HUGEPAGE);
+#endif
+    region_backing = "thp";
+    return 0;
+}
+
+const sf_page_provider sf_hugepage_pages = {
+    "hugepage", hugepage_init, region_fini, region_grow, region_start_addr, region_end_addr, 1, region_discard
+};
+
+/* selection */
+
+static const sf_page_provider *provider = &sf_sfutil_pages;
+static size_t provider_reserve = SF_DEFAULT_RESERVE;
+// set by a switch until the next heap is set up; sfutil's region keeps its
+// old pages, so until then the heap has to read as empty from here
+static int heap_dropped = 0;
+
+int sf_set_page_provider(const sf_page_provider *p, size_t reserve) {
+    if (p == NULL) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    sf_heap_enter();
+    if (sf_heap_forget() < 0) {
+        sf_heap_leave();
+        return -1;
+    }
+    if (provider != &sf_sfutil_pages) {
+        // sfutil's region belongs to whoever called sf_mem_init, leave it alone
+        provider->fini();
+    }
+    provider = p;
+    provider_reserve = reserve ? reserve : SF_DEFAULT_RESERVE;
+    heap_dropped = 1;
+    sf_heap_leave();
+    return 0;
+}
+
+const sf_page_provider *sf_get_page_provider(void) {
+    return provider;
+}
+
+const char *sf_page_backing(void) {
+    if (provider == &sf_mmap_pages || provider == &sf_hugepage_pages) {
+        return region_backing;
+    }
+    return provider->name;
+}
+
+int sf_heap_init(void) {
+    if (provider->init(provider_reserve) < 0) {
+        sf_errno = ENOMEM;
+        return -1;
+    }
+    heap_dropped = 0;
+    return 0;
+}
+
+void *sf_heap_grow(void) {
+    return provider->grow();
+}
+
+void *sf_heap_start(void) {
+    return heap_dropped ? NULL : provider->start();
+}
+
+void *sf_heap_end(void) {
+    return heap_dropped ? NULL : provider->end();
+}
+
+int sf_heap_zeroed(void) {
+    return provider->zeroed;
+}
+
+size_t sf_heap_discard(void *start, void *end) {
+    // only whole pages; the provider may round further in to what it can drop
+    char *lo = (char *)(((uintptr_t)start + PAGE_SZ - 1) & ~(uintptr_t)(PAGE_SZ - 1));
+    char *hi = (char *)((uintptr_t)end & ~(uintptr_t)(PAGE_SZ - 1));
+    if (provider->discard == NULL || lo >= hi) {
+        return 0;
+    }
+    return provider->discard(lo, hi - lo);
+}
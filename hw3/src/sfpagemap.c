@@ -0,0 +1,266 @@
+/**
+ * Radix page map of block starts, for sf_owns and sf_block_of, and the
+ * allocation tag of each block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfpagemap.h"
+
+/*
+ * The heap is split into PAGE_SZ pages of 64 granules each.  Granule g of a
+ * page has bit g set in the page's word if a block payload starts there.
+ * Pages are grouped into leaves of LEAF_PAGES, allocated as the heap reaches
+ * them.  Two summary levels record which pages of a leaf, and which leaves,
+ * have any bit set, so finding the last block start at or before an address
+ * takes a bounded number of word scans whatever the block sizes.  Leaves also
+ * keep a tag byte per granule, meaningful where an allocated block starts.
+ */
+#define GRANULE 64
+#define GRANULES_PER_PAGE (PAGE_SZ / GRANULE)   // 64, one bit each
+#define LEAF_SHIFT 9
+#define LEAF_PAGES (1 << LEAF_SHIFT)
+#define MAX_LEAVES 2048                         // 4 GiB of heap, the most a block size can describe
+#define WORD_BITS 64
+
+typedef struct pagemap_leaf {
+    uint64_t starts[LEAF_PAGES];
+    uint64_t used[LEAF_PAGES / WORD_BITS];      // pages with a block start
+    uint8_t tags[LEAF_PAGES * GRANULES_PER_PAGE];
+} pagemap_leaf;
+
+static pagemap_leaf *leaves[MAX_LEAVES];
+static uint64_t leaves_used[MAX_LEAVES / WORD_BITS];
+static char *map_base = NULL;                   // heap start the map was built for
+static int map_ok = 0;                          // cleared if a leaf cannot be allocated
+
+static int highest_bit(uint64_t w) {
+    return WORD_BITS - 1 - __builtin_clzll(w);
+}
+
+// bits 0..n inclusive
+static uint64_t bits_upto(int n) {
+    return n >= WORD_BITS - 1 ? ~0ull : (2ull << n) - 1;
+}
+
+void sf_pagemap_reset(void) {
+    size_t i;
+    for (i = 0; i < MAX_LEAVES; i++) {
+        if (leaves[i] != NULL) {
+            memset(leaves[i], 0, sizeof(pagemap_leaf));
+        }
+    }
+    memset(leaves_used, 0, sizeof(leaves_used));
+    map_base = sf_heap_start();
+    map_ok = 1;
+}
+
+int sf_pagemap_reserve(void) {
+    if (!map_ok) {
+        return -1;
+    }
+    size_t pages = ((char *)sf_heap_end() - map_base + PAGE_SZ - 1) / PAGE_SZ;
+    size_t leaf;
+    for (leaf = 0; leaf < (pages + LEAF_PAGES - 1) >> LEAF_SHIFT; leaf++) {
+        if (leaf >= MAX_LEAVES) {
+            return -1;
+        }
+        if (leaves[leaf] == NULL && (leaves[leaf] = calloc(1, sizeof(pagemap_leaf))) == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void sf_pagemap_set(sf_block *bp) {
+    if (!map_ok) {
+        return;
+    }
+    size_t g = ((char *)bp->body.payload - map_base) / GRANULE;
+    size_t page = g / GRANULES_PER_PAGE;
+    size_t leaf = page >> LEAF_SHIFT;
+    if (leaf >= MAX_LEAVES) {
+        map_ok = 0;
+        return;
+    }
+    pagemap_leaf *lp = leaves[leaf];
+    if (lp == NULL) {
+        // the map lives outside the heap, like the fit index
+        lp = calloc(1, sizeof(pagemap_leaf));
+        if (lp == NULL) {
+            map_ok = 0;
+            return;
+        }
+        leaves[leaf] = lp;
+    }
+    size_t pi = page & (LEAF_PAGES - 1);
+    lp->starts[pi] |= 1ull << (g % GRANULES_PER_PAGE);
+    lp->used[pi / WORD_BITS] |= 1ull << (pi % WORD_BITS);
+    leaves_used[leaf / WORD_BITS] |= 1ull << (leaf % WORD_BITS);
+}
+
+void sf_pagemap_clear(sf_block *bp) {
+    if (!map_ok) {
+        return;
+    }
+    size_t g = ((char *)bp->body.payload - map_base) / GRANULE;
+    size_t page = g / GRANULES_PER_PAGE;
+    size_t leaf = page >> LEAF_SHIFT;
+    pagemap_leaf *lp = leaf < MAX_LEAVES ? leaves[leaf] : NULL;
+    if (lp == NULL) {
+        return;
+    }
+    size_t pi = page & (LEAF_PAGES - 1);
+    lp->starts[pi] &= ~(1ull << (g % GRANULES_PER_PAGE));
+    if (lp->starts[pi] != 0) {
+        return;
+    }
+    lp->used[pi / WORD_BITS] &= ~(1ull << (pi % WORD_BITS));
+    size_t w;
+    for (w = 0; w < LEAF_PAGES / WORD_BITS; w++) {
+        if (lp->used[w] != 0) {
+            return;
+        }
+    }
+    leaves_used[leaf / WORD_BITS] &= ~(1ull << (leaf % WORD_BITS));
+}
+
+// tag byte of the block at bp, or NULL if its leaf is missing
+static uint8_t *tag_slot(sf_block *bp) {
+    if (!map_ok) {
+        return NULL;
+    }
+    size_t g = ((char *)bp->body.payload - map_base) / GRANULE;
+    size_t leaf = g / GRANULES_PER_PAGE >> LEAF_SHIFT;
+    if (leaf >= MAX_LEAVES || leaves[leaf] == NULL) {
+        return NULL;
+    }
+    return &leaves[leaf]->tags[g & (LEAF_PAGES * GRANULES_PER_PAGE - 1)];
+}
+
+int sf_pagemap_set_tag(sf_block *bp, int tag) {
+    uint8_t *slot = tag_slot(bp);
+    if (slot == NULL) {
+        return -1;
+    }
+    *slot = tag;
+    return 0;
+}
+
+int sf_pagemap_tag(sf_block *bp) {
+    uint8_t *slot = tag_slot(bp);
+    return slot == NULL ? 0 : *slot;
+}
+
+// last used page at or before page index pi of lp, or -1
+static long last_page(pagemap_leaf *lp, long pi) {
+    long w = pi / WORD_BITS;
+    uint64_t bits = lp->used[w] & bits_upto(pi % WORD_BITS);
+    while (bits == 0) {
+        if (--w < 0) {
+            return -1;
+        }
+        bits = lp->used[w];
+    }
+    return w * WORD_BITS + highest_bit(bits);
+}
+
+// payload of the last block starting at or before granule g, or NULL
+static char *last_start(size_t g) {
+    long page = g / GRANULES_PER_PAGE;
+    long leaf = page >> LEAF_SHIFT;
+    if (leaf >= MAX_LEAVES) {
+        return NULL;
+    }
+
+    // same page
+    pagemap_leaf *lp = leaves[leaf];
+    if (lp != NULL) {
+        long pi = page & (LEAF_PAGES - 1);
+        uint64_t bits = lp->starts[pi] & bits_upto(g % GRANULES_PER_PAGE);
+        if (bits != 0) {
+            return map_base + (page * GRANULES_PER_PAGE + highest_bit(bits)) * GRANULE;
+        }
+        // earlier pages of the same leaf
+        if (pi > 0) {
+            long p = last_page(lp, pi - 1);
+            if (p >= 0) {
+                page = (leaf << LEAF_SHIFT) + p;
+                return map_base + (page * GRANULES_PER_PAGE + highest_bit(lp->starts[p])) * GRANULE;
+            }
+        }
+    }
+
+    // earlier leaves
+    if (leaf == 0) {
+        return NULL;
+    }
+    long w = (leaf - 1) / WORD_BITS;
+    uint64_t bits = leaves_used[w] & bits_upto((leaf - 1) % WORD_BITS);
+    while (bits == 0) {
+        if (--w < 0) {
+            return NULL;
+        }
+        bits = leaves_used[w];
+    }
+    leaf = w * WORD_BITS + highest_bit(bits);
+    lp = leaves[leaf];
+    long p = last_page(lp, LEAF_PAGES - 1);
+    page = (leaf << LEAF_SHIFT) + p;
+    return map_base + (page * GRANULES_PER_PAGE + highest_bit(lp->starts[p])) * GRANULE;
+}
+
+// walks the heap from the prologue; only used if the map could not be kept
+static char *walk_to(const char *ptr) {
+    sf_block *bp = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // prologue
+    bp = next_blockp(bp);
+    char *found = NULL;
+    while (get_size(bp) != 0 && (char *)bp->body.payload <= ptr) {
+        found = (char *)bp->body.payload;
+        bp = next_blockp(bp);
+    }
+    return found;
+}
+
+static void *block_of(const void *ptr) {
+    char *p = (char *)ptr;
+    char *start = sf_heap_start();
+    char *end = sf_heap_end();
+    if (p < start || p >= end || start == end) {
+        return NULL;
+    }
+    char *payload;
+    if (map_ok && map_base == start) {
+        payload = last_start((p - start) / GRANULE);
+    } else {
+        payload = walk_to(p);
+    }
+    if (payload == NULL) {
+        return NULL;
+    }
+    sf_block *bp = (sf_block *)(payload - (sizeof(sf_header) + sizeof(sf_footer)));
+    // the payload runs up to the next block's header
+    if (!get_alloc(bp) || p >= payload + get_size(bp) - sizeof(sf_header)) {
+        return NULL;
+    }
+    return payload;
+}
+
+void *sf_block_of(const void *ptr) {
+    if (SF_GUARD_OWNS(ptr)) {
+        return sf_guard_block_of(ptr);
+    }
+    // the map and the headers are rewritten by the maintenance thread too
+    sf_heap_enter();
+    void *payload = block_of(ptr);
+    sf_heap_leave();
+    return payload;
+}
+
+int sf_owns(const void *ptr) {
+    return sf_block_of(ptr) != NULL;
+}
@@ -0,0 +1,221 @@
+/**
+ * Hardware performance counters for the allocator entry points.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfperf.h"
+
+// the last slot collects the calibration calls made by sf_perf_open
+static sf_perf_counts counts[SF_NUM_OPS + 1];
+static uint64_t overhead[SF_PERF_NUM_COUNTERS];
+static int counting = 0;    // mask of the counters in the group
+
+static const char *op_names[SF_NUM_OPS] = {
+    "sf_malloc", "sf_free", "sf_realloc", "sf_memalign"
+};
+
+static const char *counter_names[SF_PERF_NUM_COUNTERS] = {
+    "cycles", "instr", "L1d miss", "LLC miss", "dTLB miss", "br miss", "faults"
+};
+
+#ifdef SF_PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define CALIBRATION_CALLS 1000
+
+__thread int sf_perf_fd = -1;
+__thread int sf_perf_depth = 0;
+
+// what one read of the group gives back, with PERF_FORMAT_GROUP and both times
+typedef struct group_read {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[SF_PERF_NUM_COUNTERS];
+} group_read;
+
+static int member_fds[SF_PERF_NUM_COUNTERS];
+static int members[SF_PERF_NUM_COUNTERS];   // counter of each value in a read
+static int num_members = 0;
+static __thread group_read at_enter;
+static uint64_t time_enabled = 0;
+static uint64_t time_running = 0;
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[SF_PERF_NUM_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int open_counter(int counter, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.disabled = group_fd < 0;   // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static int read_group(group_read *r) {
+    size_t len = (3 + num_members) * sizeof(uint64_t);
+    return read(sf_perf_fd, r, len) == len ? 0 : -1;
+}
+
+void sf_perf_begin(void) {
+    if (read_group(&at_enter) < 0) {
+        at_enter.nr = 0;
+    }
+}
+
+void sf_perf_end(int op) {
+    group_read now;
+    if (at_enter.nr == 0 || read_group(&now) < 0) {
+        return;
+    }
+    sf_perf_counts *c = &counts[op];
+    int i;
+    c->calls++;
+    for (i = 0; i < num_members; i++) {
+        c->values[members[i]] += now.values[i] - at_enter.values[i];
+    }
+    time_enabled += now.time_enabled - at_enter.time_enabled;
+    time_running += now.time_running - at_enter.time_running;
+}
+
+int sf_perf_open(void) {
+    if (sf_perf_fd >= 0 || num_members > 0) {
+        sf_errno = EBUSY;
+        return -1;
+    }
+    int first_errno = 0;
+    int counter;
+    counting = 0;
+    for (counter = 0; counter < SF_PERF_NUM_COUNTERS; counter++) {
+        int fd = open_counter(counter, num_members > 0 ? member_fds[0] : -1);
+        if (fd < 0) {
+            if (first_errno == 0) {
+                first_errno = errno;
+            }
+            continue;
+        }
+        member_fds[num_members] = fd;
+        members[num_members++] = counter;
+        counting |= 1 << counter;
+    }
+    if (num_members == 0) {
+        sf_errno = first_errno;
+        return -1;
+    }
+    ioctl(member_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    sf_perf_fd = member_fds[0];
+
+    // what reading the counters around an empty call costs
+    int i;
+    memset(&counts[SF_NUM_OPS], 0, sizeof(sf_perf_counts));
+    for (i = 0; i < CALIBRATION_CALLS; i++) {
+        sf_perf_begin();
+        sf_perf_end(SF_NUM_OPS);
+    }
+    for (i = 0; i < SF_PERF_NUM_COUNTERS; i++) {
+        overhead[i] = counts[SF_NUM_OPS].calls ? counts[SF_NUM_OPS].values[i] / counts[SF_NUM_OPS].calls : 0;
+    }
+    return counting;
+}
+
+void sf_perf_close(void) {
+    int i;
+    if (sf_perf_fd < 0) {
+        return;
+    }
+    for (i = num_members - 1; i >= 0; i--) {
+        close(member_fds[i]);
+    }
+    num_members = 0;
+    sf_perf_fd = -1;
+}
+
+#else
+
+int sf_perf_open(void) {
+    sf_errno = ENOTSUP;
+    return -1;
+}
+
+void sf_perf_close(void) {
+}
+
+#endif
+
+const sf_perf_counts *sf_perf_get(int op) {
+    if (op < 0 || op >= SF_NUM_OPS) {
+        return NULL;
+    }
+    return &counts[op];
+}
+
+void sf_perf_reset(void) {
+    memset(counts, 0, SF_NUM_OPS * sizeof(sf_perf_counts));
+#ifdef SF_PERF
+    time_enabled = 0;
+    time_running = 0;
+#endif
+}
+
+void sf_perf_dump(FILE *out, const char *title) {
+    int op, i, any = 0;
+    for (op = 0; op < SF_NUM_OPS; op++) {
+        any |= counts[op].calls != 0;
+    }
+    if (!any) {
+        return;
+    }
+    fprintf(out, "%s, per call\n  %-12s %10s", title, "", "calls");
+    for (i = 0; i < SF_PERF_NUM_COUNTERS; i++) {
+        fprintf(out, " %10s", counter_names[i]);
+    }
+    fprintf(out, "\n");
+    for (op = 0; op < SF_NUM_OPS; op++) {
+        const sf_perf_counts *c = &counts[op];
+        if (c->calls == 0) {
+            continue;
+        }
+        fprintf(out, "  %-12s %10llu", op_names[op], (unsigned long long)c->calls);
+        for (i = 0; i < SF_PERF_NUM_COUNTERS; i++) {
+            if (!(counting & (1 << i))) {
+                fprintf(out, " %10s", "-");
+                continue;
+            }
+            double mean = (double)c->values[i] / c->calls - overhead[i];
+            fprintf(out, " %10.2f", mean > 0 ? mean : 0.0);
+        }
+        fprintf(out, "\n");
+    }
+#ifdef SF_PERF
+    // the kernel shares out hardware counters when there are not enough of them
+    if (time_running < time_enabled) {
+        fprintf(out, "  (counted %.0f%% of the time, the rest is missing)\n", 100.0 * time_running / time_enabled);
+    }
+#endif
+}
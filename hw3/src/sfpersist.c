@@ -0,0 +1,176 @@
+/**
+ * Persistent heaps in memory-mapped files.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfoheap.h"
+#include "sfpersist.h"
+
+struct sf_pheap {
+    sf_oheap *h;        // start of the mapping
+    size_t size;
+    int fd;
+    int recovered;
+};
+
+// the header sits in the first page, so this is what has to reach the disk first
+static int sync_header(sf_oheap *h) {
+    return msync(h, PAGE_SZ, MS_SYNC);
+}
+
+sf_pheap *sf_pheap_open(const char *path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        sf_errno = errno;
+        return NULL;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        sf_errno = errno == EWOULDBLOCK ? EBUSY : errno;
+        close(fd);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        sf_errno = errno;
+        close(fd);
+        return NULL;
+    }
+
+    int fresh = st.st_size == 0;
+    if (fresh) {
+        size = ((size + PAGE_SZ - 1) / PAGE_SZ) * PAGE_SZ;
+        if (size < SF_OHEAP_MIN_SIZE || size > BLOCK_SIZE_MASK) {
+            sf_errno = EINVAL;
+            close(fd);
+            return NULL;
+        }
+        if (ftruncate(fd, size) != 0) {
+            sf_errno = errno;
+            close(fd);
+            return NULL;
+        }
+    } else {
+        size = st.st_size;
+        if (size < SF_OHEAP_MIN_SIZE) {
+            sf_errno = EINVAL;
+            close(fd);
+            return NULL;
+        }
+    }
+
+    sf_oheap *h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        sf_errno = errno;
+        close(fd);
+        return NULL;
+    }
+    sf_pheap *heap = malloc(sizeof(sf_pheap));
+    if (heap == NULL) {
+        sf_errno = ENOMEM;
+        munmap(h, size);
+        close(fd);
+        return NULL;
+    }
+    heap->h = h;
+    heap->size = size;
+    heap->fd = fd;
+    heap->recovered = 0;
+
+    if (fresh) {
+        // dirty from the start: the magic number may reach the disk before the blocks do
+        sf_oheap_format(h, size, 1);
+    } else if (!sf_oheap_valid(h, size)) {
+        sf_errno = EINVAL;
+        munmap(h, size);
+        close(fd);
+        free(heap);
+        return NULL;
+    } else if (h->dirty) {
+        // last writer died with the heap open
+        if (sf_oheap_rebuild(h) < 0) {
+            sf_errno = EINVAL;
+            munmap(h, size);
+            close(fd);
+            free(heap);
+            return NULL;
+        }
+        heap->recovered = 1;
+    }
+
+    // the dirty mark must be on disk before any block is touched
+    h->dirty = 1;
+    if (sync_header(h) != 0) {
+        sf_errno = errno;
+        munmap(h, size);
+        close(fd);
+        free(heap);
+        return NULL;
+    }
+    return heap;
+}
+
+int sf_pheap_sync(sf_pheap *heap) {
+    if (msync(heap->h, heap->size, MS_SYNC) != 0) {
+        sf_errno = errno;
+        return -1;
+    }
+    return 0;
+}
+
+int sf_pheap_close(sf_pheap *heap) {
+    int ret = 0;
+    // everything else is on disk before the heap is marked clean
+    if (sf_pheap_sync(heap) == 0) {
+        heap->h->dirty = 0;
+        if (sync_header(heap->h) != 0) {
+            sf_errno = errno;
+            ret = -1;
+        }
+    } else {
+        ret = -1;
+    }
+    munmap(heap->h, heap->size);
+    close(heap->fd); // drops the lock
+    free(heap);
+    return ret;
+}
+
+int sf_pheap_recovered(sf_pheap *heap) {
+    return heap->recovered;
+}
+
+void *sf_pheap_malloc(sf_pheap *heap, size_t size) {
+    return sf_oheap_malloc(heap->h, size);
+}
+
+void sf_pheap_free(sf_pheap *heap, void *pp) {
+    if (pp != NULL && sf_oheap_offset(heap->h, pp) == heap->h->root) {
+        heap->h->root = 0;
+    }
+    sf_oheap_free(heap->h, pp);
+}
+
+void *sf_pheap_root(sf_pheap *heap) {
+    return sf_oheap_at(heap->h, heap->h->root);
+}
+
+void sf_pheap_set_root(sf_pheap *heap, void *pp) {
+    heap->h->root = sf_oheap_offset(heap->h, pp);
+}
+
+uint64_t sf_pheap_offset(sf_pheap *heap, void *pp) {
+    return sf_oheap_offset(heap->h, pp);
+}
+
+void *sf_pheap_at(sf_pheap *heap, uint64_t offset) {
+    return sf_oheap_at(heap->h, offset);
+}
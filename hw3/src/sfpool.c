@@ -0,0 +1,102 @@
+/**
+ * Fixed-size object pools on top of sf_malloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfpool.h"
+
+#define POOL_DEFAULT_ALIGN 16
+#define POOL_MIN_OBJECTS 8
+
+typedef struct sf_ppage {
+    struct sf_ppage *next;
+} sf_ppage;
+
+typedef struct sf_pobj {
+    struct sf_pobj *next;   // only meaningful while the object is free
+} sf_pobj;
+
+struct sf_pool {
+    size_t stride;          // object size rounded up to the alignment
+    size_t first;           // offset of the first object in a page
+    size_t page_size;       // bytes requested from sf_malloc per page
+    sf_ppage *pages;
+    sf_pobj *free_objs;
+};
+
+sf_pool *sf_pool_create(size_t obj_size, size_t align) {
+    if (align == 0) {
+        align = POOL_DEFAULT_ALIGN;
+    }
+    // pages are payloads of sfmm blocks, which are only 64-byte aligned
+    if (obj_size == 0 || (align & (align - 1)) != 0 || align > 64) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    sf_pool *pool = sf_malloc(sizeof(sf_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (obj_size < sizeof(sf_pobj)) {
+        obj_size = sizeof(sf_pobj);
+    }
+    pool->stride = (obj_size + align - 1) & ~(align - 1);
+    pool->first = (sizeof(sf_ppage) + align - 1) & ~(align - 1);
+    // one page worth of block, unless that would hold too few objects
+    pool->page_size = PAGE_SZ - sizeof(sf_header);
+    if (pool->first + POOL_MIN_OBJECTS * pool->stride > pool->page_size) {
+        pool->page_size = pool->first + POOL_MIN_OBJECTS * pool->stride;
+    }
+    pool->pages = NULL;
+    pool->free_objs = NULL;
+    return pool;
+}
+
+static int grow_pool(sf_pool *pool) {
+    sf_ppage *page = sf_malloc(pool->page_size);
+    if (page == NULL) {
+        return -1;
+    }
+    page->next = pool->pages;
+    pool->pages = page;
+    // thread the objects so the lowest address is handed out first
+    size_t count = (pool->page_size - pool->first) / pool->stride;
+    sf_pobj *head = pool->free_objs;
+    while (count-- > 0) {
+        sf_pobj *obj = (sf_pobj *)((char *)page + pool->first + count * pool->stride);
+        obj->next = head;
+        head = obj;
+    }
+    pool->free_objs = head;
+    return 0;
+}
+
+void *sf_pool_alloc(sf_pool *pool) {
+    if (pool->free_objs == NULL && grow_pool(pool) < 0) {
+        return NULL;
+    }
+    sf_pobj *obj = pool->free_objs;
+    pool->free_objs = obj->next;
+    return obj;
+}
+
+void sf_pool_free(sf_pool *pool, void *obj) {
+    if (obj == NULL) {
+        return;
+    }
+    ((sf_pobj *)obj)->next = pool->free_objs;
+    pool->free_objs = obj;
+}
+
+void sf_pool_destroy(sf_pool *pool) {
+    sf_ppage *page = pool->pages;
+    while (page != NULL) {
+        sf_ppage *next = page->next;
+        sf_free(page);
+        page = next;
+    }
+    sf_free(pool);
+}
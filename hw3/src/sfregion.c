@@ -0,0 +1,146 @@
+/**
+ * Region (arena) allocation on top of sf_malloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfregion.h"
+
+#define REGION_DEFAULT_ALIGN 16
+
+typedef struct sf_rchunk {
+    struct sf_rchunk *next;
+    size_t size;            // usable bytes after this header
+    char data[];
+} sf_rchunk;
+
+struct sf_region {
+    sf_rchunk *first;       // chunks are filled in list order
+    sf_rchunk *cur;         // chunk being bumped into
+    char *bump;             // next free byte in cur
+    size_t chunk_size;
+    size_t used_before;     // bytes used in the chunks before cur
+    sf_region_stats stats;
+};
+
+sf_region *sf_region_create(size_t chunk_size) {
+    sf_region *r = sf_malloc(sizeof(sf_region));
+    if (r == NULL) {
+        return NULL;
+    }
+    if (chunk_size == 0) {
+        // chunk header plus data make up exactly one page worth of block
+        chunk_size = PAGE_SZ - sizeof(sf_header) - sizeof(sf_rchunk);
+    }
+    r->first = NULL;
+    r->cur = NULL;
+    r->bump = NULL;
+    r->chunk_size = chunk_size;
+    r->used_before = 0;
+    r->stats.chunks = 0;
+    r->stats.capacity = 0;
+    r->stats.used = 0;
+    r->stats.high_water = 0;
+    r->stats.resets = 0;
+    return r;
+}
+
+// bytes from the bump pointer to the end of cur
+static size_t room(sf_region *r) {
+    return r->cur == NULL ? 0 : (size_t)(r->cur->data + r->cur->size - r->bump);
+}
+
+// moves on to a chunk with at least need bytes (plus alignment slack) after cur
+static int next_chunk(sf_region *r, size_t need) {
+    if (r->cur != NULL) {
+        r->used_before += r->bump - r->cur->data;
+    }
+    sf_rchunk *c = r->cur == NULL ? r->first : r->cur->next;
+    sf_rchunk *prev = r->cur;
+    // chunks kept from before the last reset are reused if they are large enough
+    while (c != NULL && c->size < need) {
+        prev = c;
+        c = c->next;
+    }
+    if (c == NULL) {
+        size_t size = need > r->chunk_size ? need : r->chunk_size;
+        if (size > SIZE_MAX - sizeof(sf_rchunk)) {
+            sf_errno = ENOMEM; // a chunk size given to sf_region_create
+            return -1;
+        }
+        c = sf_malloc(sizeof(sf_rchunk) + size);
+        if (c == NULL) {
+            return -1;
+        }
+        c->size = size;
+        if (prev == NULL) {
+            c->next = r->first;
+            r->first = c;
+        } else {
+            c->next = prev->next;
+            prev->next = c;
+        }
+        r->stats.chunks++;
+        r->stats.capacity += size;
+    }
+    r->cur = c;
+    r->bump = c->data;
+    return 0;
+}
+
+void *sf_region_alloc(sf_region *r, size_t size, size_t align) {
+    if (align == 0) {
+        align = REGION_DEFAULT_ALIGN;
+    }
+    if ((align & (align - 1)) != 0) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > SIZE_MAX - sizeof(sf_rchunk) - (align - 1)) {
+        sf_errno = ENOMEM; // no chunk could hold it, and need would wrap
+        return NULL;
+    }
+    size_t pad = r->cur == NULL ? 0 : (-(uintptr_t)r->bump) & (align - 1);
+    if (r->cur == NULL || pad > room(r) || size > room(r) - pad) {
+        // worst case padding at the start of a fresh chunk
+        if (next_chunk(r, size + align - 1) < 0) {
+            return NULL;
+        }
+        pad = (-(uintptr_t)r->bump) & (align - 1);
+    }
+    char *p = r->bump + pad;
+    r->bump = p + size;
+    r->stats.used = r->used_before + (r->bump - r->cur->data);
+    if (r->stats.used > r->stats.high_water) {
+        r->stats.high_water = r->stats.used;
+    }
+    return p;
+}
+
+void sf_region_reset(sf_region *r) {
+    r->cur = NULL;
+    r->bump = NULL;
+    r->used_before = 0;
+    r->stats.used = 0;
+    r->stats.resets++;
+}
+
+void sf_region_destroy(sf_region *r) {
+    sf_rchunk *c = r->first;
+    while (c != NULL) {
+        sf_rchunk *next = c->next;
+        sf_free(c);
+        c = next;
+    }
+    sf_free(r);
+}
+
+void sf_region_get_stats(sf_region *r, sf_region_stats *stats) {
+    *stats = r->stats;
+}
@@ -0,0 +1,192 @@
+/**
+ * Shared-memory heaps in named POSIX shared-memory segments.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfoheap.h"
+#include "sfshm.h"
+
+// the segment starts with the heap header; the lock goes in the space before the heap proper
+typedef struct shm_header {
+    sf_oheap heap;
+    pthread_mutex_t lock;
+} shm_header;
+
+typedef char shm_header_fits[sizeof(shm_header) <= SF_OHEAP_START ? 1 : -1];
+
+struct sf_shm {
+    shm_header *seg;
+    size_t size;
+};
+
+static sf_shm *map_segment(int fd, size_t size) {
+    shm_header *seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        sf_errno = errno;
+        return NULL;
+    }
+    sf_shm *shm = malloc(sizeof(sf_shm));
+    if (shm == NULL) {
+        sf_errno = ENOMEM;
+        munmap(seg, size);
+        return NULL;
+    }
+    shm->seg = seg;
+    shm->size = size;
+    return shm;
+}
+
+sf_shm *sf_shm_create(const char *name, size_t size) {
+    size = ((size + PAGE_SZ - 1) / PAGE_SZ) * PAGE_SZ;
+    if (size < SF_OHEAP_MIN_SIZE || size > BLOCK_SIZE_MASK) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
+        sf_errno = errno;
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        sf_errno = errno;
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    sf_shm *shm = map_segment(fd, size);
+    if (shm == NULL) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->seg->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    // publishes the heap to attach, so it goes last
+    sf_oheap_format(&shm->seg->heap, size, 0);
+    return shm;
+}
+
+sf_shm *sf_shm_attach(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        sf_errno = errno;
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        sf_errno = errno;
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        // created, not sized yet
+        sf_errno = EAGAIN;
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size < SF_OHEAP_MIN_SIZE) {
+        sf_errno = EINVAL;
+        close(fd);
+        return NULL;
+    }
+    sf_shm *shm = map_segment(fd, st.st_size);
+    if (shm == NULL) {
+        return NULL;
+    }
+    if (!sf_oheap_valid(&shm->seg->heap, shm->size)) {
+        // no magic until the creator's format finishes
+        sf_errno = __atomic_load_n(&shm->seg->heap.magic, __ATOMIC_ACQUIRE) == 0 ? EAGAIN : EINVAL;
+        sf_shm_detach(shm);
+        return NULL;
+    }
+    return shm;
+}
+
+void sf_shm_detach(sf_shm *shm) {
+    munmap(shm->seg, shm->size);
+    free(shm);
+}
+
+int sf_shm_unlink(const char *name) {
+    if (shm_unlink(name) != 0) {
+        sf_errno = errno;
+        return -1;
+    }
+    return 0;
+}
+
+static int lock_heap(sf_shm *shm) {
+    int err = pthread_mutex_lock(&shm->seg->lock);
+    if (err == EOWNERDEAD) {
+        // the holder died, possibly halfway through an update
+        if (sf_oheap_rebuild(&shm->seg->heap) < 0) {
+            pthread_mutex_unlock(&shm->seg->lock); // leaves it unusable for everyone
+            return -1;
+        }
+        pthread_mutex_consistent(&shm->seg->lock);
+        err = 0;
+    }
+    return err == 0 ? 0 : -1;
+}
+
+static void unlock_heap(sf_shm *shm) {
+    pthread_mutex_unlock(&shm->seg->lock);
+}
+
+void *sf_shm_malloc(sf_shm *shm, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (lock_heap(shm) < 0) {
+        sf_errno = ENOTRECOVERABLE;
+        return NULL;
+    }
+    void *pp = sf_oheap_malloc(&shm->seg->heap, size);
+    unlock_heap(shm);
+    return pp;
+}
+
+void sf_shm_free(sf_shm *shm, void *pp) {
+    if (lock_heap(shm) < 0) {
+        abort();
+        return;
+    }
+    sf_oheap *h = &shm->seg->heap;
+    if (pp != NULL && sf_oheap_offset(h, pp) == h->root) {
+        h->root = 0;
+    }
+    sf_oheap_free(h, pp);
+    unlock_heap(shm);
+}
+
+void *sf_shm_root(sf_shm *shm) {
+    sf_oheap *h = &shm->seg->heap;
+    return sf_oheap_at(h, __atomic_load_n(&h->root, __ATOMIC_ACQUIRE));
+}
+
+void sf_shm_set_root(sf_shm *shm, void *pp) {
+    sf_oheap *h = &shm->seg->heap;
+    __atomic_store_n(&h->root, sf_oheap_offset(h, pp), __ATOMIC_RELEASE);
+}
+
+uint64_t sf_shm_offset(sf_shm *shm, void *pp) {
+    return sf_oheap_offset(&shm->seg->heap, pp);
+}
+
+void *sf_shm_at(sf_shm *shm, uint64_t offset) {
+    return sf_oheap_at(&shm->seg->heap, offset);
+}
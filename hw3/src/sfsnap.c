@@ -0,0 +1,94 @@
+/**
+ * Binary heap snapshots.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sfsnap.h"
+
+#define SNAP_BATCH 256
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            sf_errno = errno;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// the first block after the prologue, or NULL if the heap has not been set up
+static sf_block *first_block(void) {
+    if (sf_heap_start() == sf_heap_end()) {
+        return NULL;
+    }
+    sf_block *prologue = (sf_block *)((void *)sf_heap_start() + (sizeof(sf_header) * 6)); // 48
+    return next_blockp(prologue);
+}
+
+static int snapshot(int fd) {
+    sf_snap_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SF_SNAP_MAGIC;
+    hdr.version = SF_SNAP_VERSION;
+    hdr.num_lists = NUM_FREE_LISTS;
+    hdr.heap_start = (uintptr_t)sf_heap_start();
+    hdr.heap_size = sf_heap_end() - sf_heap_start();
+
+    sf_block *bp;
+    sf_block *first = first_block();
+    for (bp = first; bp != NULL && get_size(bp) != 0; bp = next_blockp(bp)) {
+        hdr.num_records++;
+    }
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0) {
+        return -1;
+    }
+
+    sf_snap_record batch[SNAP_BATCH];
+    size_t n = 0;
+    for (bp = first; bp != NULL && get_size(bp) != 0; bp = next_blockp(bp)) {
+        sf_snap_record *rec = &batch[n++];
+        rec->offset = (void *)bp - sf_heap_start();
+        rec->size = get_size(bp);
+        rec->flags = bp->header & (THIS_BLOCK_ALLOCATED | PREV_BLOCK_ALLOCATED);
+        rec->reserved = 0;
+        if (get_alloc(bp)) {
+            rec->list = SF_SNAP_NO_LIST;
+        } else if (is_wilderness(bp)) {
+            rec->list = NUM_FREE_LISTS - 1;
+        } else {
+            rec->list = free_list_index(get_size(bp));
+        }
+        if (n == SNAP_BATCH) {
+            if (write_all(fd, batch, n * sizeof(sf_snap_record)) < 0) {
+                return -1;
+            }
+            n = 0;
+        }
+    }
+    if (n > 0 && write_all(fd, batch, n * sizeof(sf_snap_record)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int sf_heap_snapshot(int fd) {
+    sf_heap_enter();
+    int ret = snapshot(fd);
+    sf_heap_leave();
+    return ret;
+}
@@ -0,0 +1,81 @@
+/**
+ * Per-tag live and peak byte counters.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sftag.h"
+
+// Only the heap's owner allocates and frees (other threads' frees are counted
+// when the owner drains them), so the counters need no atomics.
+typedef struct tag_count {
+    size_t live;
+    size_t peak;
+} tag_count;
+
+static tag_count tag_counts[SF_MAX_TAGS];
+__thread int sf_current_tag = SF_TAG_NONE;
+
+void sf_tag_alloc(sf_block *bp, int tag) {
+    if (sf_pagemap_set_tag(bp, tag) < 0) {
+        tag = SF_TAG_NONE; // reads back as 0, count it there
+    }
+    tag_count *tc = &tag_counts[tag];
+    tc->live += get_size(bp);
+    if (tc->live > tc->peak) {
+        tc->peak = tc->live;
+    }
+}
+
+int sf_tag_free(sf_block *bp) {
+    int tag = sf_pagemap_tag(bp);
+    size_t size = get_size(bp);
+    // only short if the page map was lost after the block was counted
+    tag_counts[tag].live -= size <= tag_counts[tag].live ? size : tag_counts[tag].live;
+    return tag;
+}
+
+void sf_tag_reset(void) {
+    memset(tag_counts, 0, sizeof(tag_counts));
+}
+
+int sf_tag_set(int tag) {
+    if (tag < 0 || tag >= SF_MAX_TAGS) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    int prev = sf_current_tag;
+    sf_current_tag = tag;
+    return prev;
+}
+
+int sf_tag_get(void) {
+    return sf_current_tag;
+}
+
+int sf_tag_of(void *pp) {
+    if (SF_GUARD_OWNS(pp)) {
+        return sf_guard_tag(pp);
+    }
+    if (pp == NULL || !valid_pointer(pp)) {
+        return -1;
+    }
+    return sf_pagemap_tag((sf_block *)((void *)(pp) - (sizeof(sf_header) + sizeof(sf_footer))));
+}
+
+size_t sf_tag_live(int tag) {
+    if (tag < 0 || tag >= SF_MAX_TAGS) {
+        return 0;
+    }
+    return tag_counts[tag].live;
+}
+
+size_t sf_tag_peak(int tag) {
+    if (tag < 0 || tag >= SF_MAX_TAGS) {
+        return 0;
+    }
+    return tag_counts[tag].peak;
+}
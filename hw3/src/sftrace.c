@@ -0,0 +1,254 @@
+/**
+ * Allocation event tracing through per-thread rings and a flusher thread.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_internal.h"
+#include "sftrace.h"
+
+#ifdef SF_TRACE
+
+#define RING_EVENTS 16384               // per thread, a power of two
+#define FLUSH_INTERVAL_NS 1000000       // 1 ms
+
+// One producer (the owning thread) and one consumer (the flusher): the thread
+// only moves tail and the flusher only moves head.  Rings are never freed; the
+// ring of a thread that has exited is reused by the next thread to trace.
+typedef struct trace_ring {
+    uint64_t tail;
+    uint64_t dropped;
+    char pad[64];                       // keep head off the producer's line
+    uint64_t head;
+    struct trace_ring *next;
+    int in_use;
+    uint16_t id;
+    sf_trace_event events[RING_EVENTS];
+} trace_ring;
+
+int sf_trace_on = 0;
+static trace_ring *rings = NULL;
+static uint16_t num_rings = 0;
+static __thread trace_ring *my_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static int trace_fd = -1;
+static pthread_t flusher;
+static int stopping = 0;
+static int write_errno = 0;
+static uint64_t written = 0;
+
+static uint64_t trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void release_ring(void *arg) {
+    trace_ring *r = arg;
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static trace_ring *register_ring(void) {
+    pthread_once(&ring_key_once, make_ring_key);
+    trace_ring *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &unused, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (r == NULL) {
+        r = calloc(1, sizeof(trace_ring));
+        if (r == NULL) {
+            return NULL;
+        }
+        r->in_use = 1;
+        r->id = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+        r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(ring_key, r);
+    my_ring = r;
+    return r;
+}
+
+void sf_trace_record(int op, size_t size, size_t align, void *ptr, void *old) {
+    trace_ring *r = my_ring;
+    if (r == NULL && (r = register_ring()) == NULL) {
+        return;
+    }
+    uint64_t tail = r->tail;
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= RING_EVENTS) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    sf_trace_event *e = &r->events[tail & (RING_EVENTS - 1)];
+    e->time = trace_clock();
+    e->size = size;
+    e->ptr = (uintptr_t)ptr;
+    e->old = (uintptr_t)old;
+    e->align = align;
+    e->thread = r->id;
+    e->op = op;
+    e->reserved = 0;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void write_all(const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0 && write_errno == 0) {
+        ssize_t n = write(trace_fd, p, len);
+        if (n < 0) {
+            if (errno != EINTR) {
+                write_errno = errno;
+            }
+            continue;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+// writes out whatever every ring holds; only the flusher (or sf_trace_stop, once
+// the flusher is gone) calls this
+static void flush_rings(void) {
+    trace_ring *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        uint64_t head = r->head;
+        uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        while (head < tail) {
+            // up to the end of the buffer, then from its start
+            size_t at = head & (RING_EVENTS - 1);
+            size_t n = tail - head < RING_EVENTS - at ? tail - head : RING_EVENTS - at;
+            write_all(&r->events[at], n * sizeof(sf_trace_event));
+            head += n;
+            written += n;
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void *flusher_main(void *arg) {
+    struct timespec interval = { 0, FLUSH_INTERVAL_NS };
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        flush_rings();
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+static sf_trace_header make_header(void) {
+    sf_trace_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SF_TRACE_MAGIC;
+    hdr.version = SF_TRACE_VERSION;
+    hdr.event_size = sizeof(sf_trace_event);
+#if defined(__x86_64__) || defined(__i386__)
+    hdr.clock = SF_TRACE_CLOCK_TSC;
+#else
+    hdr.clock = SF_TRACE_CLOCK_NS;
+#endif
+    hdr.heap_start = (uintptr_t)sf_heap_start();
+    return hdr;
+}
+
+int sf_trace_start(const char *path) {
+    if (trace_fd >= 0) {
+        sf_errno = EBUSY;
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        sf_errno = errno;
+        return -1;
+    }
+    trace_fd = fd;
+    write_errno = 0;
+    written = 0;
+    // header goes first and is completed by sf_trace_stop
+    sf_trace_header hdr = make_header();
+    write_all(&hdr, sizeof(hdr));
+
+    trace_ring *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        // anything left over belongs to the last trace
+        __atomic_store_n(&r->head, __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        __atomic_store_n(&r->dropped, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stopping, 0, __ATOMIC_RELAXED);
+    int err = pthread_create(&flusher, NULL, flusher_main, NULL);
+    if (err != 0 || write_errno != 0) {
+        if (err == 0) {
+            __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+            pthread_join(flusher, NULL);
+        }
+        sf_errno = err != 0 ? err : write_errno;
+        close(fd);
+        trace_fd = -1;
+        return -1;
+    }
+    __atomic_store_n(&sf_trace_on, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sf_trace_stop(void) {
+    if (trace_fd < 0) {
+        sf_errno = EINVAL;
+        return -1;
+    }
+    __atomic_store_n(&sf_trace_on, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    flush_rings();
+
+    sf_trace_header hdr = make_header();
+    hdr.num_events = written;
+    trace_ring *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        hdr.dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    }
+    if (write_errno == 0 && pwrite(trace_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        write_errno = errno;
+    }
+    if (close(trace_fd) < 0 && write_errno == 0) {
+        write_errno = errno;
+    }
+    trace_fd = -1;
+    if (write_errno != 0) {
+        sf_errno = write_errno;
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+int sf_trace_start(const char *path) {
+    sf_errno = ENOTSUP;
+    return -1;
+}
+
+int sf_trace_stop(void) {
+    sf_errno = EINVAL;
+    return -1;
+}
+
+#endif
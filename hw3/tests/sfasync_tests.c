@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 200809L
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+
+void assert_free_block_count(size_t size, int count);
+
+// waits up to a second for the maintenance thread to empty its queue
+static void wait_for_queue(void) {
+	struct timespec ms = { 0, 1000000 };
+	for (int i = 0; i < 1000 && sf_free_async_pending() != 0; i++)
+		nanosleep(&ms, NULL);
+	cr_assert_eq(sf_free_async_pending(), 0, "Queue was not drained!");
+	nanosleep(&ms, NULL); // the last batch may still be in progress
+}
+
+Test(sf_async_suite, frees_in_background, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *p[50];
+	sf_free(sf_malloc(10)); // set up the heap first
+	cr_assert_eq(sf_free_async_start(0), 0, "Thread did not start!");
+	cr_assert_eq(sf_free_async_start(0), -1, "Thread was started twice!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+
+	for (int i = 0; i < 50; i++)
+		p[i] = sf_malloc(100 + i * 10);
+	for (int i = 0; i < 50; i++)
+		sf_free_async(p[i]);
+	wait_for_queue();
+	void *x = sf_malloc(200); // the owner keeps allocating meanwhile
+	sf_free(x);
+	cr_assert_eq(sf_free_async_stop(), 0, "Thread did not stop!");
+	assert_free_block_count(0, 1);
+
+	sf_errno = 0;
+	cr_assert_eq(sf_free_async_stop(), -1, "Stopped twice!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sf_async_suite, full_queue_frees_inline, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *p[400];
+	sf_free(sf_malloc(10));
+	for (int i = 0; i < 400; i++)
+		p[i] = sf_malloc(64);
+	cr_assert_eq(sf_free_async_start(8), 0, "Thread did not start!");
+	for (int i = 0; i < 400; i++) {
+		sf_free_async(p[i]);
+		cr_assert_leq(sf_free_async_pending(), 8, "Queue grew past its limit!");
+	}
+	cr_assert_eq(sf_free_async_stop(), 0, "Thread did not stop!");
+	cr_assert_eq(sf_free_async_pending(), 0, "Stop left blocks queued!");
+	assert_free_block_count(0, 1);
+}
+
+#define PER_THREAD 64
+
+static void *blocks[4][PER_THREAD];
+
+static void *free_elsewhere(void *arg) {
+	void **mine = arg;
+	for (int i = 0; i < PER_THREAD; i++) {
+		if (i % 2)
+			sf_free_async(mine[i]);
+		else
+			sf_free(mine[i]);
+	}
+	return NULL;
+}
+
+Test(sf_async_suite, mixed_with_remote_frees, .init = sf_mem_init, .fini = sf_mem_fini) {
+	for (int t = 0; t < 4; t++)
+		for (int i = 0; i < PER_THREAD; i++)
+			blocks[t][i] = sf_malloc(32 + (i % 5) * 24);
+	sf_prefill(64, 16);
+	cr_assert_eq(sf_free_async_start(64), 0, "Thread did not start!");
+
+	pthread_t threads[4];
+	for (int t = 0; t < 4; t++)
+		pthread_create(&threads[t], NULL, free_elsewhere, blocks[t]);
+	// the owner churns while the others free
+	for (int r = 0; r < 200; r++) {
+		void *a = sf_malloc(50);
+		void *b = sf_malloc(300);
+		cr_assert(a != NULL && b != NULL, "Owner allocation failed!");
+		sf_free_async(a);
+		sf_free(b);
+	}
+	for (int t = 0; t < 4; t++)
+		pthread_join(threads[t], NULL);
+	wait_for_queue();
+	cr_assert_eq(sf_free_async_stop(), 0, "Thread did not stop!");
+	sf_heap_drain();
+	sf_trim(); // gives back the prefilled blocks the thread topped up
+	assert_free_block_count(0, 1);
+}
+
+static int start_result, start_errno;
+
+static void *start_elsewhere(void *arg) {
+	start_result = sf_free_async_start(0);
+	start_errno = sf_errno;
+	return NULL;
+}
+
+Test(sf_async_suite, only_owner_starts, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_free(sf_malloc(10));
+	pthread_t t;
+	pthread_create(&t, NULL, start_elsewhere, NULL);
+	pthread_join(t, NULL);
+	cr_assert_eq(start_result, -1, "Started by a thread that does not own the heap!");
+	cr_assert_eq(start_errno, EPERM, "sf_errno is not EPERM!");
+	// without the thread it is just sf_free
+	void *p = sf_malloc(100);
+	sf_free_async(p);
+	assert_free_block_count(0, 1);
+}
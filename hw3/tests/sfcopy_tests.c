@@ -0,0 +1,89 @@
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfcopy.h"
+
+#define BUF_SIZE (1 << 16)
+
+static unsigned char src[BUF_SIZE + 64], dst[BUF_SIZE + 64], ref[BUF_SIZE + 64];
+
+static void fill(unsigned char *buf, size_t n, int seed) {
+	for (size_t i = 0; i < n; i++)
+		buf[i] = (unsigned char)(i * 31 + seed);
+}
+
+static void check_one(int isa, size_t n, size_t d, size_t s) {
+	fill(src, sizeof(src), 1);
+	fill(dst, sizeof(dst), 2);
+	memcpy(ref, dst, sizeof(dst));
+	memcpy(ref + d, src + s, n);
+	sf_copy(dst + d, src + s, n);
+	cr_assert(memcmp(dst, ref, sizeof(dst)) == 0, "%s copy of %zu bytes (+%zu/+%zu) is wrong!",
+		  sf_copy_isa_name(isa), n, d, s);
+
+	memset(ref + d, 0, n);
+	sf_zero(dst + d, n);
+	cr_assert(memcmp(dst, ref, sizeof(dst)) == 0, "%s zero of %zu bytes (+%zu) is wrong!",
+		  sf_copy_isa_name(isa), n, d);
+}
+
+// a spread of sizes around the vector widths, at every misalignment of 0..3 and 61..63
+static void check_isa(int isa) {
+	size_t sizes[] = { 0, 1, 15, 63, 64, 127, 128, 129, 255, 256, 257, 1000, 4096, 40000 };
+	size_t offs[] = { 0, 1, 2, 3, 61, 62, 63 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (size_t j = 0; j < sizeof(offs) / sizeof(offs[0]); j++)
+			check_one(isa, sizes[i], offs[j], offs[(j + 3) % 7]);
+	}
+}
+
+Test(sf_copy_suite, every_isa_copies_and_zeroes) {
+	for (int isa = 0; isa < SF_NUM_ISAS; isa++) {
+		if (sf_copy_select(isa) < 0)
+			continue;
+		cr_assert_eq(sf_copy_isa(), isa, "Kernel was not selected!");
+		check_isa(isa);
+	}
+	cr_assert_eq(sf_copy_select(SF_NUM_ISAS), -1, "Selected an unknown kernel!");
+}
+
+Test(sf_copy_suite, streaming_stores) {
+	sf_copy_nt_threshold = 256;
+	for (int isa = 0; isa < SF_NUM_ISAS; isa++) {
+		if (sf_copy_select(isa) == 0)
+			check_isa(isa);
+	}
+}
+
+Test(sf_copy_suite, copy_onto_lower_overlapping_range) {
+	sf_copy_nt_threshold = 4096;
+	size_t shifts[] = { 1, 64, 100, 4096 };
+	for (int isa = 0; isa < SF_NUM_ISAS; isa++) {
+		if (sf_copy_select(isa) < 0)
+			continue;
+		for (size_t k = 0; k < sizeof(shifts) / sizeof(shifts[0]); k++) {
+			size_t n = 20000;
+			fill(dst, sizeof(dst), 3);
+			memcpy(ref, dst, sizeof(dst));
+			memmove(ref + 5, ref + 5 + shifts[k], n);
+			sf_copy(dst + 5, dst + 5 + shifts[k], n);
+			cr_assert(memcmp(dst, ref, sizeof(dst)) == 0, "%s overlapping copy by %zu is wrong!",
+				  sf_copy_isa_name(isa), shifts[k]);
+		}
+	}
+}
+
+// every size streams; the ones shorter than the head must not run past n
+Test(sf_copy_suite, short_sizes_with_no_threshold) {
+	sf_copy_nt_threshold = 0;
+	for (int isa = 0; isa < SF_NUM_ISAS; isa++) {
+		if (sf_copy_select(isa) < 0)
+			continue;
+		for (size_t n = 0; n <= 300; n++) {
+			check_one(isa, n, 1, 3);
+			check_one(isa, n, 33, 7);
+			check_one(isa, n, 63, 61);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfepoch.h"
+#include "sfpagemap.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_epoch_suite, retired_block_outlives_read_section, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *x = sf_malloc(100);
+	cr_assert_eq(sf_epoch_enter(), 0, "Could not enter!");
+	cr_assert_eq(sf_retire(x), 0, "Could not retire!");
+	cr_assert_eq(sf_epoch_reclaim(), 0, "Block freed inside the read section!");
+	cr_assert(sf_owns(x), "Retired block is no longer allocated!");
+	sf_epoch_exit();
+
+	cr_assert_eq(sf_epoch_reclaim(), 1, "Block was not reclaimed!");
+	cr_assert(!sf_owns(x), "Reclaimed block is still allocated!");
+	assert_free_block_count(0, 1);
+}
+
+static pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int reader_in, reader_go;
+
+static void *reader(void *arg) {
+	sf_epoch_enter();
+	pthread_mutex_lock(&gate);
+	reader_in = 1;
+	pthread_cond_broadcast(&cond);
+	while (!reader_go)
+		pthread_cond_wait(&cond, &gate);
+	pthread_mutex_unlock(&gate);
+	sf_epoch_exit();
+	return NULL;
+}
+
+Test(sf_epoch_suite, waits_for_other_readers, .init = sf_mem_init, .fini = sf_mem_fini) {
+	pthread_t t;
+	pthread_create(&t, NULL, reader, NULL);
+	pthread_mutex_lock(&gate);
+	while (!reader_in)
+		pthread_cond_wait(&cond, &gate);
+	pthread_mutex_unlock(&gate);
+
+	char *x = sf_malloc(200);
+	sf_retire(x);
+	cr_assert_eq(sf_epoch_reclaim(), 0, "Block freed while a reader may hold it!");
+	cr_assert_eq(sf_epoch_reclaim(), 0, "Block freed while a reader may hold it!");
+	cr_assert(sf_owns(x), "Retired block is no longer allocated!");
+
+	pthread_mutex_lock(&gate);
+	reader_go = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&gate);
+	pthread_join(t, NULL);
+
+	cr_assert_eq(sf_epoch_reclaim(), 1, "Block was not reclaimed after the reader left!");
+	cr_assert(!sf_owns(x), "Reclaimed block is still allocated!");
+}
+
+#define NUM_NODES 1000
+
+static void *nodes[NUM_NODES];
+
+static void *retirer(void *arg) {
+	for (int i = 0; i < NUM_NODES; i++) {
+		sf_epoch_enter();
+		sf_retire(nodes[i]);
+		sf_epoch_exit();
+	}
+	sf_epoch_reclaim();
+	return NULL;
+}
+
+Test(sf_epoch_suite, batches_from_other_thread, .init = sf_mem_init, .fini = sf_mem_fini) {
+	for (int i = 0; i < NUM_NODES; i++)
+		nodes[i] = sf_malloc(48);
+
+	pthread_t t;
+	pthread_create(&t, NULL, retirer, NULL);
+	pthread_join(t, NULL);
+
+	// everything went back through the remote queue in batches
+	cr_assert_eq(sf_heap_drain(), NUM_NODES, "Not every retired block was freed!");
+	assert_free_block_count(0, 1);
+}
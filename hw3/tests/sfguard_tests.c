@@ -0,0 +1,126 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfguard.h"
+#include "sfpagemap.h"
+#include "sftag.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_guard_suite, samples_into_the_pool, .init = sf_mem_init, .fini = sf_mem_fini) {
+	cr_assert_eq(sf_guard_start(4, 1), 0, "Pool was not set up!");
+	cr_assert_eq(sf_guard_start(4, 1), -1, "Sampling was started twice!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+
+	char *p[5];
+	for (int i = 0; i < 4; i++) {
+		p[i] = sf_malloc(100);
+		cr_assert(sf_guard_owns(p[i]), "Block %d was not guarded!", i);
+		cr_assert_eq((uintptr_t)p[i] % 64, 0, "Block %d is not aligned!", i);
+		cr_assert_eq(sf_malloc_usable_size(p[i]), 128, "Wrong usable size!");
+		memset(p[i], 'a' + i, 128);
+	}
+	p[4] = sf_malloc(100); // the pool is full
+	cr_assert(!sf_guard_owns(p[4]), "Pool handed out a fifth block!");
+	cr_assert(!sf_guard_owns(sf_malloc(5000)), "Block bigger than a page was guarded!");
+
+	sf_guard_stats stats;
+	sf_guard_get_stats(&stats);
+	cr_assert_eq(stats.slots, 4, "Wrong slot count!");
+	cr_assert_eq(stats.live, 4, "Wrong live count!");
+	cr_assert_eq(stats.sampled, 4, "Wrong sampled count!");
+	cr_assert_eq(stats.missed, 2, "Wrong missed count!");
+
+	for (int i = 0; i < 5; i++)
+		sf_free(p[i]);
+	// every slot has been written; reused ones come back zeroed
+	char *z = sf_calloc(10, 10);
+	cr_assert(sf_guard_owns(z), "calloc was not guarded!");
+	for (int i = 0; i < 100; i++)
+		cr_assert_eq(z[i], 0, "Reused slot was not cleared!");
+	sf_free(z);
+
+	sf_guard_stop();
+	cr_assert(!sf_guard_owns(sf_malloc(100)), "Sampled after sf_guard_stop!");
+	sf_guard_get_stats(&stats);
+	cr_assert_eq(stats.live, 0, "Guarded blocks still live!");
+}
+
+Test(sf_guard_suite, realloc_moves_to_the_heap, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_guard_start(0, 1);
+	char *p = sf_malloc_tagged(60, 7);
+	cr_assert(sf_guard_owns(p), "Block was not guarded!");
+	cr_assert_eq(sf_tag_of(p), 7, "Tag was not kept!");
+	memcpy(p, "guarded", 8);
+	sf_guard_stop();
+	char *q = sf_realloc(p, 300);
+	cr_assert(!sf_guard_owns(q), "Block was not moved to the heap!");
+	cr_assert_str_eq(q, "guarded", "Payload was not kept!");
+	cr_assert_eq(sf_tag_of(q), 7, "Tag was lost!");
+	sf_free(q);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_guard_suite, guarded_blocks_are_owned, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_guard_start(4, 1);
+	char *p = sf_malloc(100);
+	cr_assert(sf_guard_owns(p), "Block was not guarded!");
+	cr_assert(sf_owns(p), "Guarded block is not owned!");
+	cr_assert_eq(sf_block_of(p), p, "Wrong block for the payload start!");
+	cr_assert_eq(sf_block_of(p + 127), p, "Wrong block for the payload end!");
+	cr_assert_null(sf_block_of(p + 128), "Found a block past the payload!");
+	sf_free(p);
+	cr_assert(!sf_owns(p), "Freed guarded block is still owned!");
+}
+
+Test(sf_guard_suite, access_past_the_end_is_reported, .init = sf_mem_init, .fini = sf_mem_fini) {
+	int fds[2];
+	cr_assert_eq(pipe(fds), 0, "pipe failed!");
+	pid_t pid = fork();
+	cr_assert(pid >= 0, "fork failed!");
+	if (pid == 0) {
+		dup2(fds[1], STDERR_FILENO);
+		sf_guard_start(0, 1);
+		char *p = sf_malloc(128);
+		// 128 is a multiple of 64, so the block touches a guard on one side
+		if (((uintptr_t)p + 128) % sysconf(_SC_PAGESIZE) == 0)
+			p[130] = 1;
+		else
+			p[-3] = 1;
+		_exit(0);
+	}
+	close(fds[1]);
+	char report[4096];
+	size_t n = 0;
+	ssize_t r;
+	while (n < sizeof(report) - 1 && (r = read(fds[0], report + n, sizeof(report) - 1 - n)) > 0)
+		n += r;
+	report[n] = '\0';
+	int status;
+	waitpid(pid, &status, 0);
+	cr_assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV, "Child did not die of SIGSEGV!");
+	cr_assert(strstr(report, "2 bytes past the end of a 128-byte block") != NULL
+		|| strstr(report, "3 bytes before a 128-byte block") != NULL, "Wrong report: %s", report);
+	cr_assert(strstr(report, "allocated by thread") != NULL, "No allocation stack: %s", report);
+}
+
+Test(sf_guard_suite, use_after_free_faults, .init = sf_mem_init, .fini = sf_mem_fini, .signal = SIGSEGV) {
+	sf_guard_start(0, 1);
+	volatile char *p = sf_malloc(50);
+	sf_free((void *)p);
+	p[10] = 1;
+}
+
+Test(sf_guard_suite, double_free_aborts, .init = sf_mem_init, .fini = sf_mem_fini, .signal = SIGABRT) {
+	sf_guard_start(0, 1);
+	void *p = sf_malloc(50);
+	sf_free(p);
+	sf_free(p);
+}
@@ -0,0 +1,68 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhandle.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_handle_suite, compact_slides_blocks_down, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	sf_handle a = sf_halloc(200);
+	sf_handle b = sf_halloc(300);
+	sf_handle c = sf_halloc(100);
+	cr_assert(a != NULL && b != NULL && c != NULL, "sf_halloc returned NULL!");
+
+	char *pa = sf_hlock(a);
+	memset(sf_hlock(b), 'b', 300);
+	memset(sf_hlock(c), 'c', 100);
+	sf_hunlock(a);
+	sf_hunlock(b);
+	sf_hunlock(c);
+	sf_hfree(a);
+	assert_free_block_count(256, 1);
+
+	size_t moved = sf_compact();
+	cr_assert_eq(moved, 2, "Wrong number of blocks moved (exp=2, found=%lu)", moved);
+
+	char *pb = sf_hlock(b);
+	char *pc = sf_hlock(c);
+	cr_assert(pb == pa, "b was not moved into the freed block!");
+	cr_assert(pc == pb + 320, "c was not moved up against b!");
+	for (int i = 0; i < 300; i++)
+		cr_assert(pb[i] == 'b', "Byte %d of b was not preserved!", i);
+	for (int i = 0; i < 100; i++)
+		cr_assert(pc[i] == 'c', "Byte %d of c was not preserved!", i);
+	// the hole has been merged into the wilderness
+	assert_free_block_count(0, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_handle_suite, compact_respects_locks, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_handle a = sf_halloc(200);
+	sf_handle b = sf_halloc(300);
+	void *x = sf_malloc(50);
+	sf_handle c = sf_halloc(100);
+
+	char *pb = sf_hlock(b);
+	sf_hfree(a);
+	cr_assert_eq(sf_compact(), 0, "A locked block was moved!");
+	cr_assert(sf_hlock(b) == pb, "Locked block changed address!");
+	sf_hunlock(b);
+	sf_hunlock(b);
+
+	// b can move now, but the raw block x still holds c in place
+	cr_assert_eq(sf_compact(), 1, "Wrong number of blocks moved!");
+	assert_free_block_count(256, 1);
+	sf_free(x);
+	sf_hfree(c);
+	sf_hfree(b);
+}
+
+Test(sf_handle_suite, hfree_locked_aborts, .init = sf_mem_init, .fini = sf_mem_fini, .signal = SIGABRT) {
+	sf_handle a = sf_halloc(10);
+	sf_hlock(a);
+	sf_hfree(a);
+}
@@ -0,0 +1,41 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhist.h"
+
+#ifdef SF_HIST
+Test(sf_hist_suite, calls_and_events_recorded, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_hist_reset();
+	void *x = sf_malloc(100);   // grows the heap, splits the wilderness
+	sf_malloc(100);
+	x = sf_realloc(x, 1000);    // copies
+	sf_free(x);                 // coalesces with the wilderness
+
+	const sf_hist *m = sf_hist_get(SF_OP_MALLOC);
+	const sf_hist *r = sf_hist_get(SF_OP_REALLOC);
+	const sf_hist *f = sf_hist_get(SF_OP_FREE);
+	// the sf_malloc and sf_free inside sf_realloc are not counted separately
+	cr_assert_eq(m->calls, 2, "Wrong number of sf_malloc calls (exp=2, found=%lu)", m->calls);
+	cr_assert_eq(r->calls, 1, "Wrong number of sf_realloc calls!");
+	cr_assert_eq(f->calls, 1, "Wrong number of sf_free calls!");
+
+	uint64_t grew = 0, split = 0, copied = 0, coalesced = 0;
+	for (int b = 0; b < SF_HIST_BUCKETS; b++) {
+		grew += m->buckets[b].grew;
+		split += m->buckets[b].split;
+		copied += r->buckets[b].copied;
+		coalesced += f->buckets[b].coalesced;
+	}
+	cr_assert_eq(grew, 1, "Heap growth not recorded!");
+	cr_assert_eq(split, 2, "Splits not recorded!");
+	cr_assert_eq(copied, 1, "Realloc copy not recorded!");
+	cr_assert_eq(coalesced, 1, "Coalesce not recorded!");
+}
+#endif
+
+Test(sf_hist_suite, get_out_of_range, .init = sf_mem_init, .fini = sf_mem_fini) {
+	cr_assert_null(sf_hist_get(-1), "Histogram returned for op -1!");
+	cr_assert_null(sf_hist_get(SF_NUM_OPS), "Histogram returned for op SF_NUM_OPS!");
+	cr_assert_not_null(sf_hist_get(SF_OP_FREE), "No histogram for sf_free!");
+}
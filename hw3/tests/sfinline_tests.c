@@ -0,0 +1,50 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfmm_inline.h"
+#include "sfmm_internal.h"
+
+void assert_free_block_count(size_t size, int count);
+
+struct node {
+	struct node *next;
+	long key;
+	char name[40];
+};
+
+Test(sf_inline_suite, classes_match_sf_malloc) {
+	for (size_t n = 1; n <= 5000; n++) {
+		size_t asize = SF_BLOCK_SIZE(n);
+		cr_assert(asize % 64 == 0 && asize >= n + 8 && asize < n + 8 + 64,
+			  "Wrong block size %zu for %zu bytes!", asize, n);
+		cr_assert_eq(SF_SIZE_CLASS(asize), free_list_index(asize),
+			     "Wrong class for %zu bytes!", asize);
+	}
+}
+
+Test(sf_inline_suite, constant_sizes_allocate_like_sf_malloc, .init = sf_mem_init, .fini = sf_mem_fini) {
+	struct node *a = SF_NEW(struct node);
+	char *b = SF_MALLOC(3000);
+	cr_assert_not_null(a, "a is NULL!");
+	cr_assert_not_null(b, "b is NULL!");
+	cr_assert_eq(sf_malloc_usable_size(a), 56, "Wrong usable size for a node!");
+	cr_assert_eq(sf_malloc_usable_size(b), 3000, "Wrong usable size for b!");
+	sf_free(b);
+	assert_free_block_count(0, 1);
+
+	// same placement as sf_malloc gives
+	char *c = sf_malloc(sizeof(struct node));
+	sf_free(c);
+	struct node *d = SF_NEW(struct node);
+	cr_assert(d == (struct node *)c, "Fast path did not reuse the freed block!");
+
+	// anything not constant still works
+	size_t n = 0;
+	sf_errno = 0;
+	cr_assert_null(SF_MALLOC(n), "Zero size returned a block!");
+	cr_assert(sf_errno == 0, "sf_errno was set!");
+	n = 100;
+	cr_assert_not_null(SF_MALLOC(n), "Run-time size failed!");
+}
@@ -1,8 +1,10 @@
 #include <criterion/criterion.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfmm_ext.h"
 
 void assert_free_block_count(size_t size, int count);
 void assert_free_list_block_count(size_t size, int count);
@@ -373,6 +375,223 @@ Test(sf_memsuite_student, check_errno_and_nulls, .init = sf_mem_init, .fini = sf
 
 	// if allocation not successful, NULL is returned and sf_errno = ENOMEM
 }
+Test(sf_memsuite_student, calloc_reused_block, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	char *x = sf_malloc(500);
+	sf_malloc(10);
+	memset(x, 0xff, 500);
+	sf_free(x);
+
+	char *y = sf_calloc(50, 10);
+	cr_assert(x == y, "Calloc did not reuse the freed block!");
+	for (int i = 0; i < 500; i++) {
+		cr_assert(y[i] == 0, "Byte %d of calloc'ed block is not zero!", i);
+	}
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_memsuite_student, calloc_wilderness, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	char *x = sf_malloc(3000);
+	memset(x, 0xff, 3000);
+	sf_free(x);
+
+	// spans the dirty start of the wilderness and a freshly grown page
+	char *y = sf_calloc(1, 6000);
+	cr_assert_not_null(y, "y is NULL!");
+	for (int i = 0; i < 6000; i++) {
+		cr_assert(y[i] == 0, "Byte %d of calloc'ed block is not zero!", i);
+	}
+	assert_free_block_count(0, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_memsuite_student, calloc_overflow, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	void *x = sf_calloc(0, 8);
+	cr_assert_null(x, "Calloc did not return NULL for 0 elements!");
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+
+	x = sf_calloc(SIZE_MAX / 2, 4);
+	cr_assert_null(x, "Calloc did not return NULL on overflow!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+}
+
+Test(sf_memsuite_student, reserve_grows_up_front, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_eq(sf_reserve(20000), 0, "sf_reserve failed!");
+	void *end = sf_mem_end();
+	assert_free_block_count(0, 1);
+
+	void *x = sf_malloc(20000);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(sf_mem_end() == end, "Heap grew after sf_reserve!");
+
+	cr_assert_eq(sf_reserve(PAGE_SZ * 16), -1, "Reserved more than the heap can hold!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+}
+
+Test(sf_memsuite_student, prefill_serves_mallocs, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_eq(sf_prefill(100, 8), 8, "Wrong number of blocks set aside!");
+	void *end = sf_mem_end();
+	// set aside blocks are off the free lists
+	assert_free_block_count(0, 1);
+
+	char *first = sf_malloc(100);
+	for (int i = 1; i < 8; i++) {
+		// same block size, so also served from the prefilled blocks
+		char *x = sf_malloc(90 + i);
+		cr_assert(x == first - 128 * i, "Block %d did not come from the prefilled run!", i);
+	}
+	cr_assert(sf_mem_end() == end, "Heap grew while serving prefilled blocks!");
+	assert_free_block_count(0, 1);
+
+	// calloc zeroes prefilled blocks like any other
+	cr_assert_eq(sf_prefill(100, 1), 1, "Could not prefill again!");
+	char *y = sf_calloc(1, 100);
+	for (int i = 0; i < 100; i++)
+		cr_assert(y[i] == 0, "Byte %d of calloc'ed block is not zero!", i);
+	// it sits right below the wilderness, so freeing it merges the two
+	sf_free(y);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_memsuite_student, realloc_large_block_in_place, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	void *x = sf_malloc(5000);
+	memset(x, 'x', 5000);
+	char *y = sf_realloc(x, 12000);
+	cr_assert(y == x, "Block before the wilderness moved!");
+	cr_assert(y[4999] == 'x', "Payload was not kept!");
+
+	sf_block *bp = (sf_block *)((char *)y - 2*sizeof(sf_header));
+	cr_assert((bp->header & BLOCK_SIZE_MASK) == 12032, "Realloc'ed block size not what was expected!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(128, 1); // three pages less prologue, epilogue and the block
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_memsuite_student, realloc_in_place_past_whole_wilderness, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *x = sf_malloc(5000);
+	x = sf_realloc(x, 12000);
+	// takes the rest of the wilderness, so the block ends at the epilogue
+	cr_assert(sf_realloc(x, 12160 - 8) == x, "Block before the wilderness moved!");
+	assert_free_block_count(0, 0);
+	memset(x, 'x', 12160 - 8);
+	char *y = sf_realloc(x, 20000);
+	cr_assert(y == x, "Last block did not grow in place!");
+	cr_assert(y[12151] == 'x', "Payload was not kept!");
+	sf_free(y);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_memsuite_student, usable_size_and_at_least, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	void *x = sf_malloc(70);
+	cr_assert_eq(sf_malloc_usable_size(x), 120, "Wrong usable size (exp=120, found=%lu)",
+		     sf_malloc_usable_size(x));
+	cr_assert_eq(sf_malloc_usable_size(NULL), 0, "NULL has a usable size!");
+
+	size_t actual;
+	char *y = sf_malloc_at_least(200, &actual);
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert_eq(actual, 248, "Wrong actual size (exp=248, found=%lu)", actual);
+	// all of it belongs to y
+	memset(y, 'y', actual);
+	sf_free(x);
+	sf_free(y);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(3968, 1);
+}
+
+Test(sf_memsuite_student, realloc_within_slack, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	void *x = sf_malloc(70);
+	sf_malloc(10);
+	void *y = sf_realloc(x, 120);
+	cr_assert(y == x, "Block moved although the new size fits!");
+	sf_block *bp = (sf_block *)((char *)y - 2*sizeof(sf_header));
+	cr_assert((bp->header & BLOCK_SIZE_MASK) == 128, "Block size changed!");
+	assert_free_block_count(0, 1);
+}
+
+static int pressure_calls[3];
+static size_t pressure_size;
+static void *pressure_cache;
+
+static void on_pressure(int level, size_t heap_size, void *arg) {
+	pressure_calls[level]++;
+	pressure_size = heap_size;
+	if (level == SF_PRESSURE_HARD && pressure_cache != NULL) {
+		sf_free(pressure_cache);
+		pressure_cache = NULL;
+	}
+}
+
+Test(sf_memsuite_student, soft_limit_callback, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_eq(sf_set_limit(PAGE_SZ, 0), 0, "Could not set the limits!");
+	cr_assert_eq(sf_add_pressure_callback(on_pressure, NULL), 0, "Could not add the callback!");
+	sf_malloc(100);
+	cr_assert_eq(pressure_calls[SF_PRESSURE_SOFT], 0, "Callback ran below the soft limit!");
+	sf_malloc(5000);
+	cr_assert_eq(pressure_calls[SF_PRESSURE_SOFT], 1, "Callback did not run past the soft limit!");
+	cr_assert_eq(pressure_size, 2 * PAGE_SZ, "Wrong heap size (exp=%d, found=%lu)", 2 * PAGE_SZ, pressure_size);
+	sf_malloc(5000);
+	cr_assert_eq(pressure_calls[SF_PRESSURE_SOFT], 1, "Callback ran twice for one crossing!");
+	cr_assert_eq(sf_set_limit(2 * PAGE_SZ, PAGE_SZ), -1, "Soft limit above hard limit was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sf_memsuite_student, hard_limit_frees_caches_first, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	sf_set_limit(0, 2 * PAGE_SZ);
+	sf_add_pressure_callback(on_pressure, NULL);
+	pressure_cache = sf_malloc(5000);
+	void *y = sf_malloc(5000);
+	cr_assert_eq(pressure_calls[SF_PRESSURE_HARD], 1, "Callback did not run at the hard limit!");
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+	cr_assert((char *)sf_mem_end() - (char *)sf_mem_start() == 2 * PAGE_SZ, "Heap grew past the hard limit!");
+
+	// nothing left to give back
+	cr_assert_null(sf_malloc(5000), "Allocated past the hard limit!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_eq(pressure_calls[SF_PRESSURE_HARD], 2, "Callback did not run again!");
+	cr_assert((char *)sf_mem_end() - (char *)sf_mem_start() == 2 * PAGE_SZ, "Heap grew past the hard limit!");
+}
+
+Test(sf_memsuite_student, malloc_larger_than_a_header_holds, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *x = sf_malloc(100);
+	memset(x, 'x', 100);
+	sf_errno = 0;
+	cr_assert_null(sf_malloc((size_t)1 << 40), "Block size does not fit in a header!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_errno = 0;
+	cr_assert_null(sf_malloc(SIZE_MAX), "Block size wrapped around!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_errno = 0;
+	cr_assert_null(sf_memalign((size_t)1 << 40, 128), "Block size does not fit in a header!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_errno = 0;
+	cr_assert_null(sf_realloc(x, (size_t)1 << 40), "Block size does not fit in a header!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert(x[99] == 'x', "Block was changed!");
+	sf_free(x);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_memsuite_student, hard_limit_fails_memalign, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	sf_set_limit(0, 2 * PAGE_SZ);
+	cr_assert_null(sf_memalign(20 * PAGE_SZ, 128), "Aligned block past the hard limit!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert((char *)sf_mem_end() - (char *)sf_mem_start() <= 2 * PAGE_SZ, "Heap grew past the hard limit!");
+	void *x = sf_memalign(500, 128);
+	cr_assert(((long int)x) % 128 == 0, "Block not alligned properly!");
+}
+
 /*
 Test(sf_memsuite_student, multiple_frees, .init = sf_mem_init, .fini = sf_mem_fini) {
 	debug("---OWN TEST 7---");
@@ -0,0 +1,122 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfpage.h"
+#include "sfpagemap.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_page_suite, mmap_heap_grows_past_sfutil_limit) {
+	sf_errno = 0;
+	cr_assert_eq(sf_set_page_provider(&sf_mmap_pages, 4 << 20), 0, "Could not select mmap pages!");
+	cr_assert_str_eq(sf_page_backing(), "mmap", "Wrong backing!");
+
+	char *x = sf_malloc(1 << 20);
+	cr_assert_not_null(x, "x is NULL!");
+	memset(x, 'x', 1 << 20);
+	sf_free(x);
+	assert_free_block_count(0, 1);
+
+	// the reservation is the limit
+	cr_assert_null(sf_malloc(8 << 20), "Allocated past the reservation!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
+
+Test(sf_page_suite, calloc_on_fresh_pages) {
+	sf_set_page_provider(&sf_mmap_pages, 0);
+	char *x = sf_malloc(3000);
+	memset(x, 0xff, 3000);
+	sf_free(x);
+
+	// dirty start of the wilderness, clean rest, then newly committed pages
+	char *y = sf_calloc(3, 5000);
+	cr_assert_not_null(y, "y is NULL!");
+	for (int i = 0; i < 15000; i++)
+		cr_assert(y[i] == 0, "Byte %d of calloc'ed block is not zero!", i);
+	memset(y, 0xff, 15000);
+	char *z = sf_calloc(1, 20000);
+	for (int i = 0; i < 20000; i++)
+		cr_assert(z[i] == 0, "Byte %d of calloc'ed block is not zero!", i);
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
+
+Test(sf_page_suite, hugepage_heap_falls_back) {
+	cr_assert_eq(sf_set_page_provider(&sf_hugepage_pages, 0), 0, "Could not select huge pages!");
+	void *x = sf_malloc(100);
+	cr_assert_not_null(x, "x is NULL!");
+	const char *backing = sf_page_backing();
+	cr_assert(strcmp(backing, "hugetlb") == 0 || strcmp(backing, "thp") == 0,
+		  "Unexpected backing %s", backing);
+	cr_assert(((uintptr_t)sf_get_page_provider()->start()) % (2 << 20) == 0,
+		  "Huge page heap is not 2 MiB aligned!");
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
+
+Test(sf_page_suite, null_provider) {
+	sf_errno = 0;
+	cr_assert_eq(sf_set_page_provider(NULL, 0), -1, "NULL provider was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	cr_assert(sf_get_page_provider() == &sf_sfutil_pages, "Provider changed!");
+}
+
+Test(sf_page_suite, realloc_large_block_in_place) {
+	sf_set_page_provider(&sf_mmap_pages, 64 << 20);
+	char *x = sf_malloc(1 << 20);
+	cr_assert_not_null(x, "x is NULL!");
+	memset(x, 'x', 1 << 20);
+
+	// grows into the wilderness and new pages behind it, nothing is copied
+	char *y = sf_realloc(x, 16 << 20);
+	cr_assert(y == x, "Large block moved!");
+	for (int i = 0; i < (1 << 20); i += 4096)
+		cr_assert(y[i] == 'x', "Byte %d was not kept!", i);
+	assert_free_block_count(0, 1);
+
+	// shrinking hands the pages of the tail back, they read as zeros when reused
+	memset(y + (8 << 20), 'y', 4096);
+	cr_assert(sf_realloc(y, 1 << 20) == y, "Shrunk block moved!");
+	assert_free_block_count(0, 1);
+	cr_assert(sf_realloc(y, 16 << 20) == y, "Large block moved!");
+	cr_assert(y[8 << 20] == 0, "Tail pages were not released!");
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
+
+Test(sf_page_suite, trim_gives_free_pages_back) {
+	sf_set_page_provider(&sf_mmap_pages, 0);
+	char *x = sf_malloc(64 * PAGE_SZ);
+	char *y = sf_malloc(100);
+	memset(x, 'x', 64 * PAGE_SZ);
+	cr_assert_eq(sf_trim(), 0, "Trimmed with no free pages!");
+	sf_free(x);
+	cr_assert(sf_trim() >= 62 * PAGE_SZ, "Free pages were not given back!");
+	// discarded pages come back zero-filled and still work
+	char *z = sf_malloc(64 * PAGE_SZ);
+	cr_assert(z == x, "Trimmed block was not reused!");
+	memset(z, 'z', 64 * PAGE_SZ);
+	sf_free(y);
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
+
+Test(sf_page_suite, switching_back_starts_a_fresh_heap, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *a = sf_malloc(100);
+	cr_assert_not_null(a, "a is NULL!");
+	sf_set_page_provider(&sf_mmap_pages, 0);
+	cr_assert(!sf_owns(a), "Block of the sfutil heap survived the switch!");
+	char *b = sf_malloc(1000);
+	cr_assert_not_null(b, "b is NULL!");
+	memset(b, 'b', 1000);
+	// releases the mmap heap; nothing may still point into it
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+	cr_assert(!sf_owns(b), "Block of the mmap heap survived the switch!");
+	char *c = sf_malloc(1000);
+	cr_assert_not_null(c, "c is NULL!");
+	memset(c, 'c', 1000);
+	assert_free_block_count(0, 1);
+	sf_free(c);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(3968, 1);
+}
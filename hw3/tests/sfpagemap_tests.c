@@ -0,0 +1,90 @@
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfpage.h"
+#include "sfpagemap.h"
+
+void assert_free_block_count(size_t size, int count);
+
+static void assert_block_of(char *pp, size_t size) {
+	cr_assert(sf_block_of(pp) == pp, "Start of %p not found!", pp);
+	cr_assert(sf_block_of(pp + size / 2) == pp, "Middle of %p not found!", pp);
+	cr_assert(sf_block_of(pp + size - 1) == pp, "End of %p not found!", pp);
+	cr_assert(sf_owns(pp + size - 1), "sf_owns missed %p!", pp);
+}
+
+Test(sf_pagemap_suite, interior_pointers, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *x = sf_malloc(100);
+	char *y = sf_malloc(5000);
+	char *z = sf_malloc(1);
+	assert_block_of(x, 100);
+	assert_block_of(y, 5000);
+	assert_block_of(z, 1);
+
+	// headers, free space and memory outside the heap belong to nothing
+	cr_assert_null(sf_block_of(y - 8), "Header of y was found!");
+	cr_assert_null(sf_block_of(z + 4096), "Wilderness was found!");
+	cr_assert_null(sf_block_of(&x), "Stack address was found!");
+	cr_assert_null(sf_block_of(NULL), "NULL was found!");
+	cr_assert(!sf_owns(sf_mem_start()), "Prologue is owned!");
+
+	sf_free(y);
+	cr_assert_null(sf_block_of(y + 100), "Freed y was found!");
+	cr_assert(!sf_owns(y), "sf_owns still has freed y!");
+}
+
+Test(sf_pagemap_suite, after_coalesce_and_reuse, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *a = sf_malloc(200);
+	char *b = sf_malloc(200);
+	char *c = sf_malloc(200);
+	char *d = sf_malloc(200);
+	sf_free(a);
+	sf_free(c);
+	sf_free(b); // a, b and c become one block
+
+	char *e = sf_malloc(600);
+	cr_assert(e == a, "Merged block was not reused!");
+	assert_block_of(e, 600);
+	cr_assert(sf_block_of(b + 10) == e, "Old start of b still maps to b!");
+	assert_block_of(d, 200);
+}
+
+Test(sf_pagemap_suite, memalign_and_realloc, .init = sf_mem_init, .fini = sf_mem_fini) {
+	char *x = sf_memalign(300, 1024);
+	cr_assert_not_null(x, "x is NULL!");
+	assert_block_of(x, 300);
+	cr_assert_null(sf_block_of(x - 64), "Space before aligned block was found!");
+
+	char *y = sf_malloc(100);
+	char *w = sf_realloc(y, 3000);
+	assert_block_of(w, 3000);
+	if (w != y)
+		cr_assert(!sf_owns(y), "Old block of realloc is still owned!");
+}
+
+Test(sf_pagemap_suite, large_heap_across_leaves) {
+	cr_assert_eq(sf_set_page_provider(&sf_mmap_pages, 16 << 20), 0, "Could not select mmap pages!");
+	char *ptrs[64];
+	size_t sizes[64];
+	for (int i = 0; i < 64; i++) {
+		sizes[i] = (i % 4 == 0) ? 300000 : 64 + 3 * i;
+		ptrs[i] = sf_malloc(sizes[i]);
+		cr_assert_not_null(ptrs[i], "Allocation %d failed!", i);
+	}
+	for (int i = 0; i < 64; i += 3) {
+		sf_free(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+	for (int i = 0; i < 64; i++) {
+		if (ptrs[i] == NULL)
+			continue;
+		assert_block_of(ptrs[i], sizes[i]);
+	}
+	// the far end of a big block is pages and leaves past its start
+	char *big = ptrs[4];
+	cr_assert(sf_block_of(big + 299999) == big, "Far end of big block was not found!");
+	sf_set_page_provider(&sf_sfutil_pages, 0);
+}
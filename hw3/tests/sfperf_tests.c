@@ -0,0 +1,49 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfperf.h"
+
+#ifdef SF_PERF
+
+Test(sf_perf_suite, counts_calls_per_operation, .init = sf_mem_init, .fini = sf_mem_fini) {
+	int mask = sf_perf_open();
+	if (mask < 0) {
+		// no perf_event_open here (seccomp, paranoid 3, ...); nothing to check
+		cr_assert(sf_errno != 0, "sf_errno was not set!");
+		return;
+	}
+	cr_assert_neq(mask, 0, "Open succeeded with no counters!");
+	cr_assert_eq(sf_perf_open(), -1, "Counters were opened twice!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+
+	sf_perf_reset();
+	void *p[10];
+	for (int i = 0; i < 10; i++)
+		p[i] = sf_malloc(100);
+	p[0] = sf_realloc(p[0], 5000);
+	for (int i = 0; i < 10; i++)
+		sf_free(p[i]);
+	sf_perf_close();
+	sf_free(sf_malloc(10)); // closed, not counted
+
+	cr_assert_eq(sf_perf_get(SF_OP_MALLOC)->calls, 10, "Wrong malloc calls (exp=10, found=%lu)", sf_perf_get(SF_OP_MALLOC)->calls);
+	cr_assert_eq(sf_perf_get(SF_OP_FREE)->calls, 10, "Wrong free calls!");
+	cr_assert_eq(sf_perf_get(SF_OP_REALLOC)->calls, 1, "Wrong realloc calls!");
+	cr_assert_eq(sf_perf_get(SF_OP_MEMALIGN)->calls, 0, "Memalign was counted!");
+	if (mask & (1 << SF_PERF_INSTRUCTIONS))
+		cr_assert_gt(sf_perf_get(SF_OP_MALLOC)->values[SF_PERF_INSTRUCTIONS], 0, "No instructions counted!");
+	cr_assert_null(sf_perf_get(SF_NUM_OPS), "Out of range op has counts!");
+}
+
+#else
+
+Test(sf_perf_suite, not_built_in, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_eq(sf_perf_open(), -1, "Counters opened without SF_PERF!");
+	cr_assert(sf_errno == ENOTSUP, "sf_errno is not ENOTSUP!");
+	sf_free(sf_malloc(10));
+	cr_assert_eq(sf_perf_get(SF_OP_MALLOC)->calls, 0, "Calls counted without SF_PERF!");
+}
+
+#endif
@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfpersist.h"
+
+struct node {
+	uint64_t next;		// offset of the next node
+	char name[32];
+};
+
+static char path[] = "/tmp/sfpersist_XXXXXX";
+
+static void make_path(void) {
+	int fd = mkstemp(path);
+	cr_assert(fd >= 0, "mkstemp failed!");
+	close(fd);
+}
+
+static void remove_path(void) {
+	unlink(path);
+}
+
+Test(sf_persist_suite, reopen_finds_root, .init = make_path, .fini = remove_path) {
+	sf_pheap *heap = sf_pheap_open(path, 64 << 10);
+	cr_assert_not_null(heap, "Could not create the heap!");
+	struct node *prev = NULL;
+	for (int i = 0; i < 3; i++) {
+		struct node *n = sf_pheap_malloc(heap, sizeof(struct node));
+		cr_assert_not_null(n, "Node %d is NULL!", i);
+		snprintf(n->name, sizeof(n->name), "node %d", i);
+		n->next = 0;
+		if (prev == NULL)
+			sf_pheap_set_root(heap, n);
+		else
+			prev->next = sf_pheap_offset(heap, n);
+		prev = n;
+	}
+	cr_assert_eq(sf_pheap_close(heap), 0, "Close failed!");
+
+	heap = sf_pheap_open(path, 0);
+	cr_assert_not_null(heap, "Could not reopen the heap!");
+	cr_assert(!sf_pheap_recovered(heap), "Cleanly closed heap was rebuilt!");
+	struct node *n = sf_pheap_root(heap);
+	for (int i = 0; i < 3; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "node %d", i);
+		cr_assert_not_null(n, "Node %d is missing!", i);
+		cr_assert_str_eq(n->name, name, "Node %d has the wrong name!", i);
+		n = sf_pheap_at(heap, n->next);
+	}
+	cr_assert_null(n, "List does not end after three nodes!");
+	sf_pheap_close(heap);
+}
+
+Test(sf_persist_suite, reopen_after_crash, .init = make_path, .fini = remove_path) {
+	pid_t pid = fork();
+	cr_assert(pid >= 0, "fork failed!");
+	if (pid == 0) {
+		sf_pheap *heap = sf_pheap_open(path, 64 << 10);
+		if (heap == NULL)
+			_exit(1);
+		char *root = sf_pheap_malloc(heap, 100);
+		strcpy(root, "survivor");
+		sf_pheap_set_root(heap, root);
+		void *x = sf_pheap_malloc(heap, 1000);
+		sf_pheap_malloc(heap, 2000);
+		sf_pheap_free(heap, x);
+		_exit(0); // no sf_pheap_close
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Child failed!");
+
+	sf_pheap *heap = sf_pheap_open(path, 0);
+	cr_assert_not_null(heap, "Could not reopen the heap!");
+	cr_assert(sf_pheap_recovered(heap), "Heap was not rebuilt!");
+	cr_assert_str_eq(sf_pheap_root(heap), "survivor", "Root is lost!");
+	// the freed hole and the rest of the file are both usable again
+	cr_assert_not_null(sf_pheap_malloc(heap, 1000), "Hole was not recovered!");
+	cr_assert_not_null(sf_pheap_malloc(heap, 50000), "Wilderness was not recovered!");
+	sf_pheap_close(heap);
+}
+
+Test(sf_persist_suite, open_rejects_bad_files, .init = make_path, .fini = remove_path) {
+	sf_errno = 0;
+	cr_assert_null(sf_pheap_open(path, 0), "Created a heap of size 0!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+
+	FILE *f = fopen(path, "w");
+	for (int i = 0; i < PAGE_SZ; i++)
+		fputc('x', f);
+	fclose(f);
+	sf_errno = 0;
+	cr_assert_null(sf_pheap_open(path, 0), "Opened a file that is not a heap!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+
+	unlink(path);
+	sf_pheap *heap = sf_pheap_open(path, PAGE_SZ);
+	cr_assert_not_null(heap, "Could not create the heap!");
+	sf_errno = 0;
+	cr_assert_null(sf_pheap_open(path, 0), "Opened a heap twice!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+	sf_errno = 0;
+	cr_assert_null(sf_pheap_malloc(heap, PAGE_SZ), "Allocated more than the file holds!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_pheap_close(heap);
+}
+
+Test(sf_persist_suite, free_invalid_pointer, .init = make_path, .fini = remove_path, .signal = SIGABRT) {
+	sf_pheap *heap = sf_pheap_open(path, PAGE_SZ);
+	char *x = sf_pheap_malloc(heap, 100);
+	sf_pheap_free(heap, x + 8);
+}
@@ -0,0 +1,50 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <stdint.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfpool.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_pool_suite, objects_are_packed, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	sf_pool *pool = sf_pool_create(24, 8);
+	cr_assert_not_null(pool, "pool is NULL!");
+
+	char *a = sf_pool_alloc(pool);
+	char *b = sf_pool_alloc(pool);
+	char *c = sf_pool_alloc(pool);
+	cr_assert(b == a + 24 && c == b + 24, "Pool objects are not packed densely!");
+	cr_assert(((uintptr_t)a) % 8 == 0, "Pool object not aligned properly!");
+
+	// most recently freed object is handed out first
+	sf_pool_free(pool, b);
+	cr_assert(sf_pool_alloc(pool) == b, "Freed object was not reused!");
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_pool_suite, grows_by_pages, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_pool *pool = sf_pool_create(100, 64);
+	void *objs[100];
+	for (int i = 0; i < 100; i++) {
+		objs[i] = sf_pool_alloc(pool);
+		cr_assert_not_null(objs[i], "Pool object %d is NULL!", i);
+		cr_assert(((uintptr_t)objs[i]) % 64 == 0, "Pool object not aligned properly!");
+		for (int j = 0; j < i; j++)
+			cr_assert(objs[i] != objs[j], "Pool handed out object %d twice!", j);
+	}
+	for (int i = 0; i < 100; i++)
+		sf_pool_free(pool, objs[i]);
+	sf_pool_destroy(pool);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_pool_suite, bad_alignment, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_null(sf_pool_create(32, 48), "Alignment that is not a power of 2 was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	sf_errno = 0;
+	cr_assert_null(sf_pool_create(32, 128), "Alignment above 64 was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
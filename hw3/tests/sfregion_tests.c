@@ -0,0 +1,65 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <stdint.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfregion.h"
+
+void assert_free_block_count(size_t size, int count);
+
+Test(sf_region_suite, bump_and_align, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	sf_region *r = sf_region_create(0);
+	cr_assert_not_null(r, "r is NULL!");
+
+	char *a = sf_region_alloc(r, 3, 1);
+	char *b = sf_region_alloc(r, 5, 1);
+	cr_assert(b == a + 3, "Bump allocation is not contiguous!");
+	void *c = sf_region_alloc(r, 8, 64);
+	cr_assert(((uintptr_t)c) % 64 == 0, "Region block not aligned properly!");
+	void *d = sf_region_alloc(r, 8, 0);
+	cr_assert(((uintptr_t)d) % 16 == 0, "Default region alignment is not 16!");
+
+	cr_assert_null(sf_region_alloc(r, 8, 24), "Alignment that is not a power of 2 was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	sf_region_destroy(r);
+}
+
+Test(sf_region_suite, reset_reuses_chunks, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_region *r = sf_region_create(1000);
+	sf_region_stats st;
+
+	void *first = sf_region_alloc(r, 600, 0);
+	sf_region_alloc(r, 600, 0);
+	sf_region_alloc(r, 5000, 0); // gets a chunk of its own
+	sf_region_get_stats(r, &st);
+	cr_assert_eq(st.chunks, 3, "Wrong number of chunks (exp=3, found=%lu)", st.chunks);
+	size_t peak = st.used;
+
+	sf_region_reset(r);
+	cr_assert(sf_region_alloc(r, 600, 0) == first, "Reset did not rewind to the first chunk!");
+	sf_region_alloc(r, 600, 0);
+	sf_region_alloc(r, 100, 0);
+	sf_region_get_stats(r, &st);
+	cr_assert_eq(st.chunks, 3, "Chunks were not reused after reset!");
+	cr_assert_eq(st.resets, 1, "Wrong number of resets!");
+	cr_assert_eq(st.high_water, peak, "High-water mark was not kept across the reset!");
+	cr_assert(st.used < peak, "Used bytes were not reset!");
+
+	sf_region_destroy(r);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_region_suite, huge_size_fails, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_region *r = sf_region_create(0);
+	sf_region_alloc(r, 8, 0);
+
+	sf_errno = 0;
+	cr_assert_null(sf_region_alloc(r, SIZE_MAX - 8, 16), "Allocated SIZE_MAX - 8 bytes!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_errno = 0;
+	cr_assert_null(sf_region_alloc(r, SIZE_MAX / 2, 0), "Allocated SIZE_MAX / 2 bytes!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_not_null(sf_region_alloc(r, 8, 0), "Region is unusable after a failed allocation!");
+	sf_region_destroy(r);
+}
@@ -0,0 +1,68 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+
+void assert_free_block_count(size_t size, int count);
+
+#define NUM_MSGS 20
+
+static void *msgs[NUM_MSGS];
+
+static void *consumer(void *arg) {
+	for (int i = 0; i < NUM_MSGS; i++)
+		sf_free(msgs[i]);
+	return NULL;
+}
+
+Test(sf_remote_suite, frees_from_other_thread_are_deferred, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	for (int i = 0; i < NUM_MSGS; i++)
+		msgs[i] = sf_malloc(100);
+	assert_free_block_count(0, 1);
+
+	pthread_t t;
+	pthread_create(&t, NULL, consumer, NULL);
+	pthread_join(t, NULL);
+
+	// nothing has been touched until the owner drains the queue
+	assert_free_block_count(0, 1);
+	cr_assert_eq(sf_heap_drain(), NUM_MSGS, "Not every remote free was drained!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(3968, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sf_remote_suite, drained_on_next_malloc, .init = sf_mem_init, .fini = sf_mem_fini) {
+	for (int i = 0; i < NUM_MSGS; i++)
+		msgs[i] = sf_malloc(100);
+	pthread_t t;
+	pthread_create(&t, NULL, consumer, NULL);
+	pthread_join(t, NULL);
+
+	void *x = sf_malloc(100);
+	cr_assert(x == msgs[0], "Remote frees were not coalesced before sf_malloc!");
+	cr_assert_eq(sf_heap_drain(), 0, "Queue was not empty after sf_malloc!");
+}
+
+static void *claimer(void *arg) {
+	sf_heap_claim();
+	*(size_t *)arg = sf_heap_drain();
+	return NULL;
+}
+
+Test(sf_remote_suite, claim_moves_ownership, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *x = sf_malloc(100);
+	size_t drained = 99;
+	pthread_t t;
+	pthread_create(&t, NULL, claimer, &drained);
+	pthread_join(t, NULL);
+	cr_assert_eq(drained, 0, "Nothing should have been queued!");
+
+	// the main thread is no longer the owner, so this free is queued
+	sf_free(x);
+	cr_assert_eq(sf_heap_drain(), 0, "A non-owner drained the queue!");
+	assert_free_block_count(0, 1);
+}
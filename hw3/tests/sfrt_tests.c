@@ -0,0 +1,116 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfguard.h"
+
+void assert_free_block_count(size_t size, int count);
+
+#define RT_HEAP (8 * PAGE_SZ)
+
+Test(sf_rt_suite, fixed_heap_fails_fast, .init = sf_mem_init, .fini = sf_mem_fini) {
+	cr_assert_eq(sf_rt_init(RT_HEAP), 0, "Real-time heap was not set up!");
+	size_t size = sf_mem_end() - sf_mem_start();
+	cr_assert_geq(size, RT_HEAP, "Heap is smaller than asked for!");
+	cr_assert_eq(sf_rt_init(RT_HEAP), -1, "Heap was set up twice!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+
+	void *p[200];
+	int n = 0;
+	while (n < 200 && (p[n] = sf_malloc(500)) != NULL)
+		n++;
+	cr_assert(n > 0 && n < 200, "Heap did not run out (n=%d)", n);
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_eq((size_t)(sf_mem_end() - sf_mem_start()), size, "Heap grew!");
+	cr_assert_null(sf_malloc(RT_HEAP), "Oversized request was served!");
+	for (int i = 0; i < n; i++)
+		sf_free(p[i]);
+	assert_free_block_count(0, 1);
+}
+
+Test(sf_rt_suite, search_goes_past_the_head, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_rt_init(RT_HEAP);
+	// two holes in the class for 193-320 byte blocks, the smaller one at the head
+	void *big = sf_malloc(320 - 8);
+	sf_malloc(10);
+	void *small = sf_malloc(256 - 8);
+	sf_malloc(10);
+	sf_free(big);
+	sf_free(small);
+	cr_assert_eq(sf_malloc(320 - 8), big, "Fit behind the head of the list was missed!");
+	cr_assert_eq(sf_malloc(256 - 8), small, "Head of the list was not used!");
+}
+
+Test(sf_rt_suite, search_is_bounded, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_rt_init(RT_HEAP);
+	void *big = sf_malloc(320 - 8);
+	sf_malloc(10);
+	void *small[SF_RT_SEARCH_DEPTH];
+	for (int i = 0; i < SF_RT_SEARCH_DEPTH; i++) {
+		small[i] = sf_malloc(256 - 8);
+		sf_malloc(10);
+	}
+	// every hole in front of big is too small
+	sf_free(big);
+	for (int i = 0; i < SF_RT_SEARCH_DEPTH; i++)
+		sf_free(small[i]);
+	void *p = sf_malloc(320 - 8);
+	cr_assert_not_null(p, "Request failed!");
+	cr_assert(p != big, "Search went past SF_RT_SEARCH_DEPTH blocks!");
+}
+
+Test(sf_rt_suite, realloc_never_moves, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_rt_init(RT_HEAP);
+	char *a = sf_malloc(100);
+	char *b = sf_malloc(100);
+	memset(a, 'a', 100);
+	sf_errno = 0;
+	cr_assert_null(sf_realloc(a, 1000), "Block was moved!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_eq(a[99], 'a', "Block was changed!");
+	cr_assert_eq(sf_realloc(b, 1000), b, "Block before the wilderness did not grow in place!");
+	cr_assert_eq(sf_realloc(a, 40), a, "Shrinking moved the block!");
+}
+
+static void *cross;
+
+static void *free_elsewhere(void *arg) {
+	sf_free(cross);
+	return NULL;
+}
+
+Test(sf_rt_suite, remote_frees_wait_for_drain, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_rt_init(RT_HEAP);
+	cross = sf_malloc(200);
+	pthread_t t;
+	pthread_create(&t, NULL, free_elsewhere, NULL);
+	pthread_join(t, NULL);
+	sf_free(sf_malloc(10));
+	cr_assert_neq(sf_malloc_usable_size(cross), 0, "Queued block was freed on the way into sf_malloc!");
+	cr_assert_eq(sf_heap_drain(), 1, "Queued block was not drained!");
+	assert_free_block_count(0, 1);
+	cr_assert_eq(sf_malloc(200), cross, "Drained block was not reused!");
+}
+
+Test(sf_rt_suite, memalign_fails_fast, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_rt_init(RT_HEAP);
+	size_t size = sf_mem_end() - sf_mem_start();
+	sf_errno = 0;
+	cr_assert_null(sf_memalign(20 * PAGE_SZ, 128), "Aligned block larger than the heap!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_eq((size_t)(sf_mem_end() - sf_mem_start()), size, "Heap grew!");
+	void *x = sf_memalign(500, 256);
+	cr_assert(((long int)x) % 256 == 0, "Block not alligned properly!");
+}
+
+Test(sf_rt_suite, no_guard_sampling, .init = sf_mem_init, .fini = sf_mem_fini) {
+	cr_assert_eq(sf_guard_start(4, 1), 0, "Pool was not set up!");
+	cr_assert_eq(sf_rt_init(RT_HEAP), 0, "Real-time heap was not set up!");
+	cr_assert(!sf_guard_owns(sf_malloc(100)), "Sampled in real-time mode!");
+	cr_assert_eq(sf_guard_start(4, 1), -1, "Sampling started in real-time mode!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+	cr_assert(!sf_guard_owns(sf_malloc(100)), "Sampled in real-time mode!");
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfoheap.h"
+#include "sfshm.h"
+
+static char name[64];
+
+static void make_name(void) {
+	snprintf(name, sizeof(name), "/sfshm_test_%d", (int)getpid());
+	shm_unlink(name);
+}
+
+static void remove_name(void) {
+	shm_unlink(name);
+}
+
+static int wait_child(pid_t pid) {
+	int status;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+Test(sf_shm_suite, allocate_in_child_free_in_parent, .init = make_name, .fini = remove_name) {
+	sf_shm *shm = sf_shm_create(name, 64 << 10);
+	cr_assert_not_null(shm, "Could not create the segment!");
+
+	pid_t pid = fork();
+	cr_assert(pid >= 0, "fork failed!");
+	if (pid == 0) {
+		sf_shm *child = sf_shm_attach(name);
+		if (child == NULL)
+			_exit(1);
+		char *msg = sf_shm_malloc(child, 1000);
+		if (msg == NULL)
+			_exit(2);
+		strcpy(msg, "hello from the child");
+		sf_shm_set_root(child, msg);
+		sf_shm_detach(child);
+		_exit(0);
+	}
+	cr_assert(wait_child(pid), "Child failed!");
+
+	char *msg = sf_shm_root(shm);
+	cr_assert_not_null(msg, "No message!");
+	cr_assert_str_eq(msg, "hello from the child", "Wrong message!");
+	sf_shm_free(shm, msg);
+	cr_assert_null(sf_shm_root(shm), "Root still set after free!");
+	// the whole heap is one free block again
+	cr_assert_not_null(sf_shm_malloc(shm, (64 << 10) - 1024), "Freed block was not merged back!");
+	sf_shm_detach(shm);
+}
+
+Test(sf_shm_suite, concurrent_processes, .init = make_name, .fini = remove_name) {
+	sf_shm *shm = sf_shm_create(name, 256 << 10);
+	cr_assert_not_null(shm, "Could not create the segment!");
+	pid_t pids[4];
+	for (int c = 0; c < 4; c++) {
+		pids[c] = fork();
+		cr_assert(pids[c] >= 0, "fork failed!");
+		if (pids[c] == 0) {
+			sf_shm *child = sf_shm_attach(name);
+			if (child == NULL)
+				_exit(1);
+			char *live[16] = {0};
+			for (int i = 0; i < 2000; i++) {
+				int k = i % 16;
+				if (live[k] != NULL) {
+					if (live[k][0] != (char)c)
+						_exit(3);
+					sf_shm_free(child, live[k]);
+				}
+				live[k] = sf_shm_malloc(child, 64 + (i * 37) % 1000);
+				if (live[k] == NULL)
+					_exit(2);
+				live[k][0] = (char)c;
+			}
+			for (int k = 0; k < 16; k++)
+				sf_shm_free(child, live[k]);
+			sf_shm_detach(child);
+			_exit(0);
+		}
+	}
+	for (int c = 0; c < 4; c++)
+		cr_assert(wait_child(pids[c]), "Child %d failed!", c);
+	cr_assert_not_null(sf_shm_malloc(shm, (256 << 10) - 1024), "Heap was not left whole!");
+	sf_shm_detach(shm);
+}
+
+Test(sf_shm_suite, create_and_attach_errors, .init = make_name, .fini = remove_name) {
+	sf_errno = 0;
+	cr_assert_null(sf_shm_attach(name), "Attached a missing segment!");
+	cr_assert(sf_errno == ENOENT, "sf_errno is not ENOENT!");
+
+	sf_shm *shm = sf_shm_create(name, PAGE_SZ);
+	cr_assert_not_null(shm, "Could not create the segment!");
+	sf_errno = 0;
+	cr_assert_null(sf_shm_create(name, PAGE_SZ), "Created a segment twice!");
+	cr_assert(sf_errno == EEXIST, "sf_errno is not EEXIST!");
+	sf_errno = 0;
+	cr_assert_null(sf_shm_malloc(shm, PAGE_SZ), "Allocated more than the segment holds!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_shm_detach(shm);
+	cr_assert_eq(sf_shm_unlink(name), 0, "Unlink failed!");
+}
+
+Test(sf_shm_suite, attach_while_formatting, .init = make_name, .fini = remove_name) {
+	sf_shm *shm = sf_shm_create(name, PAGE_SZ);
+	cr_assert_not_null(shm, "Could not create the segment!");
+	int fd = shm_open(name, O_RDWR, 0);
+	sf_oheap *h = mmap(NULL, PAGE_SZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	cr_assert(h != MAP_FAILED, "Could not map the segment!");
+
+	// what a creator still in sf_oheap_format looks like, whatever it has written so far
+	uint64_t magic = h->magic;
+	h->magic = 0;
+	sf_errno = 0;
+	cr_assert_null(sf_shm_attach(name), "Attached a heap that is not formatted yet!");
+	cr_assert(sf_errno == EAGAIN, "sf_errno is not EAGAIN!");
+	h->magic = magic + 1;
+	sf_errno = 0;
+	cr_assert_null(sf_shm_attach(name), "Attached a heap with a bad magic number!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	h->magic = magic;
+	sf_shm *again = sf_shm_attach(name);
+	cr_assert_not_null(again, "Could not attach the formatted heap!");
+	sf_shm_detach(again);
+	munmap(h, PAGE_SZ);
+	sf_shm_detach(shm);
+}
+
+Test(sf_shm_suite, survives_killed_process, .init = make_name, .fini = remove_name) {
+	sf_shm *shm = sf_shm_create(name, 256 << 10);
+	cr_assert_not_null(shm, "Could not create the segment!");
+	pid_t pid = fork();
+	cr_assert(pid >= 0, "fork failed!");
+	if (pid == 0) {
+		sf_shm *child = sf_shm_attach(name);
+		for (int i = 0; ; i++)
+			sf_shm_free(child, sf_shm_malloc(child, 64 + (i * 37) % 1000));
+	}
+	usleep(20000);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	// whether or not it died holding the lock, the heap must still work
+	void *x = sf_shm_malloc(shm, 100000);
+	cr_assert_not_null(x, "Heap unusable after a process was killed!");
+	sf_shm_free(shm, x);
+	sf_shm_detach(shm);
+}
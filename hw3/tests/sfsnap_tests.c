@@ -0,0 +1,45 @@
+#define _POSIX_C_SOURCE 200809L
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfsnap.h"
+
+Test(sf_snap_suite, snapshot_records_blocks, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	void *x = sf_malloc(100);
+	sf_malloc(200);
+	sf_free(x);
+
+	FILE *f = tmpfile();
+	cr_assert_not_null(f, "tmpfile failed!");
+	cr_assert_eq(sf_heap_snapshot(fileno(f)), 0, "sf_heap_snapshot failed!");
+	rewind(f);
+
+	sf_snap_header hdr;
+	sf_snap_record recs[3];
+	cr_assert_eq(fread(&hdr, sizeof(hdr), 1, f), 1, "Snapshot header missing!");
+	cr_assert_eq(hdr.magic, SF_SNAP_MAGIC, "Wrong snapshot magic!");
+	cr_assert_eq(hdr.num_records, 3, "Wrong number of records (exp=3, found=%lu)", hdr.num_records);
+	cr_assert_eq(hdr.heap_size, PAGE_SZ, "Wrong heap size!");
+	cr_assert_eq(fread(recs, sizeof(recs[0]), 3, f), 3, "Snapshot records missing!");
+
+	// freed block, allocated block, wilderness
+	cr_assert(recs[0].size == 128 && !(recs[0].flags & SF_SNAP_ALLOC), "Record 0 is wrong!");
+	cr_assert_eq(recs[0].list, 1, "Record 0 is on the wrong list!");
+	cr_assert(recs[1].size == 256 && (recs[1].flags & SF_SNAP_ALLOC), "Record 1 is wrong!");
+	cr_assert_eq(recs[1].list, SF_SNAP_NO_LIST, "Allocated block has a list!");
+	cr_assert(!(recs[1].flags & SF_SNAP_PREV_ALLOC), "Record 1 prev alloc bit is wrong!");
+	cr_assert_eq(recs[2].list, NUM_FREE_LISTS - 1, "Wilderness is on the wrong list!");
+	cr_assert_eq(recs[2].offset + recs[2].size, PAGE_SZ - 16, "Records do not reach the epilogue!");
+	fclose(f);
+}
+
+Test(sf_snap_suite, snapshot_bad_fd, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_malloc(1);
+	sf_errno = 0;
+	cr_assert_eq(sf_heap_snapshot(-1), -1, "Snapshot to a bad descriptor succeeded!");
+	cr_assert_eq(sf_errno, EBADF, "sf_errno is not EBADF!");
+}
@@ -0,0 +1,92 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfhandle.h"
+#include "sftag.h"
+
+void assert_free_block_count(size_t size, int count);
+
+#define PARSER 1
+#define CACHE 2
+
+Test(sf_tag_suite, tagged_and_scoped_allocations, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *a = sf_malloc_tagged(100, PARSER);
+	int saved = sf_tag_set(CACHE);
+	cr_assert_eq(saved, SF_TAG_NONE, "Wrong initial tag!");
+	void *b = sf_malloc(1000);
+	void *c = sf_calloc(10, 10);
+	sf_tag_set(saved);
+	void *d = sf_malloc(50);
+
+	cr_assert_eq(sf_tag_of(a), PARSER, "a has the wrong tag!");
+	cr_assert_eq(sf_tag_of(b), CACHE, "b has the wrong tag!");
+	cr_assert_eq(sf_tag_of(d), SF_TAG_NONE, "d has the wrong tag!");
+	cr_assert_eq(sf_tag_live(PARSER), 128, "Wrong parser bytes (exp=128, found=%lu)", sf_tag_live(PARSER));
+	cr_assert_eq(sf_tag_live(CACHE), 1024 + 128, "Wrong cache bytes (exp=1152, found=%lu)", sf_tag_live(CACHE));
+	cr_assert_eq(sf_tag_live(SF_TAG_NONE), 64, "Wrong untagged bytes!");
+
+	sf_free(b);
+	cr_assert_eq(sf_tag_live(CACHE), 128, "Free was not counted!");
+	cr_assert_eq(sf_tag_peak(CACHE), 1152, "Peak was not kept!");
+	sf_free(a);
+	sf_free(c);
+	sf_free(d);
+	for (int t = 0; t < 3; t++)
+		cr_assert_eq(sf_tag_live(t), 0, "Tag %d still has live bytes!", t);
+
+	sf_errno = 0;
+	cr_assert_null(sf_malloc_tagged(10, SF_MAX_TAGS), "Out of range tag was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	cr_assert_eq(sf_tag_set(-1), -1, "Out of range tag was set!");
+}
+
+Test(sf_tag_suite, realloc_keeps_tag, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *a = sf_malloc_tagged(100, PARSER);
+	sf_malloc(10);
+	a = sf_realloc(a, 2000); // moves
+	cr_assert_eq(sf_tag_of(a), PARSER, "Tag was lost when the block moved!");
+	cr_assert_eq(sf_tag_live(PARSER), 2048, "Wrong parser bytes (exp=2048, found=%lu)", sf_tag_live(PARSER));
+	a = sf_realloc(a, 500); // shrinks in place
+	cr_assert_eq(sf_tag_live(PARSER), 512, "Wrong parser bytes (exp=512, found=%lu)", sf_tag_live(PARSER));
+	cr_assert_null(sf_realloc(a, 0), "Realloc to 0 returned a block!");
+	cr_assert_eq(sf_tag_live(PARSER), 0, "Freed block is still counted!");
+
+	void *m = sf_memalign(100, 256);
+	cr_assert_eq(sf_tag_live(SF_TAG_NONE), 64 + 128, "Memalign was not counted by its final size!");
+	sf_free(m);
+}
+
+static void *cross;
+
+static void *free_elsewhere(void *arg) {
+	sf_free(cross);
+	return NULL;
+}
+
+Test(sf_tag_suite, remote_frees_and_compaction, .init = sf_mem_init, .fini = sf_mem_fini) {
+	cross = sf_malloc_tagged(300, CACHE);
+	pthread_t t;
+	pthread_create(&t, NULL, free_elsewhere, NULL);
+	pthread_join(t, NULL);
+	cr_assert_eq(sf_tag_live(CACHE), 320, "Counted before the owner drained it!");
+	sf_heap_drain();
+	cr_assert_eq(sf_tag_live(CACHE), 0, "Remote free was not counted!");
+
+	// a handle block keeps its tag when compaction moves it
+	sf_handle first = sf_halloc(10); // sets up the handle table
+	int saved = sf_tag_set(PARSER);
+	void *x = sf_malloc(200);
+	sf_handle h = sf_halloc(200);
+	sf_tag_set(saved);
+	sf_free(x);
+	sf_compact();
+	void *p = sf_hlock(h);
+	cr_assert(p == x, "Handle block did not move!");
+	cr_assert_eq(sf_tag_of(p), PARSER, "Tag was lost when the block moved!");
+	sf_hunlock(h);
+	sf_hfree(h);
+	sf_hfree(first);
+}
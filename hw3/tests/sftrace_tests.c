@@ -0,0 +1,81 @@
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhist.h"
+#include "sftrace.h"
+
+#define TRACE_FILE "/tmp/sfmm_trace_test.bin"
+
+#ifdef SF_TRACE
+
+static void *cross;
+
+static void *free_elsewhere(void *arg) {
+	sf_free(cross);
+	return NULL;
+}
+
+static int find(sf_trace_event *events, int n, int op, void *ptr) {
+	for (int i = 0; i < n; i++)
+		if (events[i].op == op && events[i].ptr == (uintptr_t)ptr)
+			return i;
+	return -1;
+}
+
+Test(sf_trace_suite, records_every_call, .init = sf_mem_init, .fini = sf_mem_fini) {
+	void *before = sf_malloc(10); // not traced
+	cr_assert_eq(sf_trace_start(TRACE_FILE), 0, "Trace did not start!");
+	cr_assert_eq(sf_trace_start(TRACE_FILE), -1, "Second trace was started!");
+	cr_assert(sf_errno == EBUSY, "sf_errno is not EBUSY!");
+
+	void *a = sf_malloc(100);
+	void *b = sf_realloc(a, 3000);
+	void *c = sf_memalign(200, 512);
+	cross = sf_malloc(40);
+	pthread_t t;
+	pthread_create(&t, NULL, free_elsewhere, NULL);
+	pthread_join(t, NULL);
+	sf_free(b);
+	sf_free(c);
+	cr_assert_eq(sf_trace_stop(), 0, "Trace did not stop cleanly!");
+	sf_free(before); // not traced either
+
+	FILE *f = fopen(TRACE_FILE, "rb");
+	cr_assert_not_null(f, "No trace file!");
+	sf_trace_header hdr;
+	sf_trace_event events[16];
+	cr_assert_eq(fread(&hdr, sizeof(hdr), 1, f), 1, "No header!");
+	cr_assert_eq(hdr.magic, SF_TRACE_MAGIC, "Bad magic!");
+	cr_assert_eq(hdr.num_events, 7, "Wrong number of events (exp=7, found=%lu)", hdr.num_events);
+	cr_assert_eq(hdr.dropped, 0, "Events were dropped!");
+	cr_assert_eq(fread(events, sizeof(sf_trace_event), 16, f), 7, "File does not hold num_events events!");
+	fclose(f);
+	remove(TRACE_FILE);
+
+	int m = find(events, 7, SF_OP_MALLOC, a);
+	int r = find(events, 7, SF_OP_REALLOC, b);
+	cr_assert(m >= 0 && events[m].size == 100, "Malloc was not recorded!");
+	cr_assert(r >= 0 && events[r].old == (uintptr_t)a && events[r].size == 3000, "Realloc was not recorded!");
+	cr_assert(events[m].time <= events[r].time, "Events are out of order!");
+	int al = find(events, 7, SF_OP_MEMALIGN, c);
+	cr_assert(al >= 0 && events[al].align == 512, "Memalign was not recorded!");
+	int rf = find(events, 7, SF_OP_FREE, cross);
+	cr_assert(rf >= 0, "Free from another thread was not recorded!");
+	cr_assert_neq(events[rf].thread, events[m].thread, "Remote free came through the owner's ring!");
+	cr_assert(find(events, 7, SF_OP_FREE, b) >= 0 && find(events, 7, SF_OP_FREE, c) >= 0, "Frees were not recorded!");
+	cr_assert_eq(find(events, 7, SF_OP_MALLOC, before), -1, "Call before the trace was recorded!");
+}
+
+#else
+
+Test(sf_trace_suite, not_built_in, .init = sf_mem_init, .fini = sf_mem_fini) {
+	sf_errno = 0;
+	cr_assert_eq(sf_trace_start(TRACE_FILE), -1, "Trace started without SF_TRACE!");
+	cr_assert(sf_errno == ENOTSUP, "sf_errno is not ENOTSUP!");
+	cr_assert_eq(sf_trace_stop(), -1, "Trace stopped without SF_TRACE!");
+}
+
+#endif
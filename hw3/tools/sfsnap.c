@@ -0,0 +1,241 @@
+/*
+ * Offline analyzer for heap snapshots written by sf_heap_snapshot().
+ *
+ *   sfsnap map FILE [WIDTH]    fragmentation map and summary
+ *   sfsnap hist FILE           block size histograms and free list occupancy
+ *   sfsnap diff OLD NEW        blocks that appeared, disappeared or changed
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "sfsnap.h"
+
+#define HIST_BUCKETS 33
+
+typedef struct snapshot {
+    sf_snap_header hdr;
+    sf_snap_record *recs;
+} snapshot;
+
+static int load(const char *path, snapshot *snap) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&snap->hdr, sizeof(snap->hdr), 1, f) != 1
+        || snap->hdr.magic != SF_SNAP_MAGIC || snap->hdr.version != SF_SNAP_VERSION) {
+        fprintf(stderr, "%s: not a version %d heap snapshot\n", path, SF_SNAP_VERSION);
+        fclose(f);
+        return -1;
+    }
+    // the count is only believed as far as the file has records for it
+    struct stat st;
+    if (fstat(fileno(f), &st) < 0 || st.st_size < (off_t)sizeof(snap->hdr)
+        || snap->hdr.num_records > (SIZE_MAX - 1) / sizeof(sf_snap_record)
+        || snap->hdr.num_records > (uint64_t)(st.st_size - sizeof(snap->hdr)) / sizeof(sf_snap_record)) {
+        fprintf(stderr, "%s: truncated snapshot\n", path);
+        fclose(f);
+        return -1;
+    }
+    snap->recs = malloc(snap->hdr.num_records * sizeof(sf_snap_record) + 1);
+    if (snap->recs == NULL
+        || fread(snap->recs, sizeof(sf_snap_record), snap->hdr.num_records, f) != snap->hdr.num_records) {
+        fprintf(stderr, "%s: truncated snapshot\n", path);
+        free(snap->recs);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int is_wild(const snapshot *s, const sf_snap_record *r) {
+    return !(r->flags & SF_SNAP_ALLOC) && r->list == s->hdr.num_lists - 1;
+}
+
+static void summary(const snapshot *s) {
+    uint64_t alloc_bytes = 0, free_bytes = 0, largest = 0, wild = 0;
+    uint64_t alloc_blocks = 0, free_blocks = 0;
+    uint64_t i;
+    for (i = 0; i < s->hdr.num_records; i++) {
+        const sf_snap_record *r = &s->recs[i];
+        if (r->flags & SF_SNAP_ALLOC) {
+            alloc_blocks++;
+            alloc_bytes += r->size;
+        } else if (is_wild(s, r)) {
+            wild += r->size;
+        } else {
+            free_blocks++;
+            free_bytes += r->size;
+            if (r->size > largest) {
+                largest = r->size;
+            }
+        }
+    }
+    printf("heap size       %10llu bytes\n", (unsigned long long)s->hdr.heap_size);
+    printf("allocated       %10llu bytes in %llu blocks\n",
+           (unsigned long long)alloc_bytes, (unsigned long long)alloc_blocks);
+    printf("free            %10llu bytes in %llu blocks (largest %llu)\n",
+           (unsigned long long)free_bytes, (unsigned long long)free_blocks, (unsigned long long)largest);
+    printf("wilderness      %10llu bytes\n", (unsigned long long)wild);
+    // share of free space (outside the wilderness) that the largest hole cannot serve
+    printf("fragmentation   %9.1f%%\n", free_bytes ? 100.0 * (free_bytes - largest) / free_bytes : 0.0);
+}
+
+/*
+ * One character per cell of the heap: '#' allocated, '.' free, '~' wilderness,
+ * '+' a cell that holds both allocated and free bytes.
+ */
+static void map(const snapshot *s, int width) {
+    uint64_t cells = 0;
+    uint64_t i;
+    if (s->hdr.num_records > 0) {
+        const sf_snap_record *last = &s->recs[s->hdr.num_records - 1];
+        cells = (last->offset + last->size - s->recs[0].offset + 63) / 64;
+    }
+    int per_line = width;
+    uint64_t cell_bytes = 64;
+    // keep the map within 32 lines
+    while (cells > (uint64_t)per_line * 32) {
+        cells = (cells + 1) / 2;
+        cell_bytes *= 2;
+    }
+    char *line = malloc(per_line + 1);
+    uint64_t r = 0;
+    uint64_t c;
+    for (c = 0; c < cells; c++) {
+        uint64_t lo = s->recs[0].offset + c * cell_bytes;
+        uint64_t hi = lo + cell_bytes;
+        int alloc = 0, fr = 0, wild = 0;
+        while (r < s->hdr.num_records && s->recs[r].offset + s->recs[r].size <= lo) {
+            r++;
+        }
+        for (i = r; i < s->hdr.num_records && s->recs[i].offset < hi; i++) {
+            if (s->recs[i].flags & SF_SNAP_ALLOC) {
+                alloc = 1;
+            } else if (is_wild(s, &s->recs[i])) {
+                wild = 1;
+            } else {
+                fr = 1;
+            }
+        }
+        char ch = alloc && (fr || wild) ? '+' : alloc ? '#' : wild ? '~' : '.';
+        line[c % per_line] = ch;
+        if (c % per_line == (uint64_t)per_line - 1 || c == cells - 1) {
+            line[c % per_line + 1] = '\0';
+            printf("%08llx  %s\n", (unsigned long long)(s->recs[0].offset + (c - c % per_line) * cell_bytes), line);
+        }
+    }
+    printf("(%llu bytes per cell)\n", (unsigned long long)cell_bytes);
+    free(line);
+    summary(s);
+}
+
+static int log2_bucket(uint64_t size) {
+    int b = 0;
+    while (size > 1 && b < HIST_BUCKETS - 1) {
+        size >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void hist(const snapshot *s) {
+    uint64_t alloc[HIST_BUCKETS] = {0}, fr[HIST_BUCKETS] = {0};
+    uint64_t lists[128] = {0};
+    uint64_t i;
+    for (i = 0; i < s->hdr.num_records; i++) {
+        const sf_snap_record *r = &s->recs[i];
+        if (r->flags & SF_SNAP_ALLOC) {
+            alloc[log2_bucket(r->size)]++;
+        } else {
+            fr[log2_bucket(r->size)]++;
+            if (r->list >= 0 && r->list < 128) {
+                lists[r->list]++;
+            }
+        }
+    }
+    printf("%-22s %10s %10s\n", "block size", "allocated", "free");
+    int b;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        if (alloc[b] || fr[b]) {
+            printf("[%9llu, %9llu) %10llu %10llu\n", 1ULL << b, 1ULL << (b + 1),
+                   (unsigned long long)alloc[b], (unsigned long long)fr[b]);
+        }
+    }
+    printf("\n%-10s %10s\n", "free list", "blocks");
+    int l;
+    for (l = 0; l < s->hdr.num_lists && l < 128; l++) {
+        printf("%-10d %10llu\n", l, (unsigned long long)lists[l]);
+    }
+}
+
+static void show(char tag, const sf_snap_record *r) {
+    printf("%c %08llx %8u %s\n", tag, (unsigned long long)r->offset, r->size,
+           (r->flags & SF_SNAP_ALLOC) ? "allocated" : "free");
+}
+
+static void diff(const snapshot *a, const snapshot *b) {
+    uint64_t i = 0, j = 0;
+    uint64_t gone = 0, added = 0, changed = 0;
+    // records are sorted by offset, so a merge pass lines them up
+    while (i < a->hdr.num_records || j < b->hdr.num_records) {
+        const sf_snap_record *x = i < a->hdr.num_records ? &a->recs[i] : NULL;
+        const sf_snap_record *y = j < b->hdr.num_records ? &b->recs[j] : NULL;
+        if (y == NULL || (x != NULL && x->offset < y->offset)) {
+            show('-', x);
+            gone++;
+            i++;
+        } else if (x == NULL || y->offset < x->offset) {
+            show('+', y);
+            added++;
+            j++;
+        } else {
+            if (x->size != y->size || (x->flags & SF_SNAP_ALLOC) != (y->flags & SF_SNAP_ALLOC)) {
+                show('-', x);
+                show('+', y);
+                changed++;
+            }
+            i++;
+            j++;
+        }
+    }
+    printf("%llu blocks gone, %llu new, %llu changed; heap %lld bytes\n",
+           (unsigned long long)gone, (unsigned long long)added, (unsigned long long)changed,
+           (long long)(b->hdr.heap_size - a->hdr.heap_size));
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: sfsnap map FILE [WIDTH]\n"
+                    "       sfsnap hist FILE\n"
+                    "       sfsnap diff OLD NEW\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char const *argv[]) {
+    snapshot a, b;
+    if (argc >= 3 && strcmp(argv[1], "map") == 0) {
+        int width = argc >= 4 ? atoi(argv[3]) : 64;
+        if (width <= 0 || load(argv[2], &a) < 0) {
+            return EXIT_FAILURE;
+        }
+        map(&a, width);
+    } else if (argc == 3 && strcmp(argv[1], "hist") == 0) {
+        if (load(argv[2], &a) < 0) {
+            return EXIT_FAILURE;
+        }
+        hist(&a);
+    } else if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+        if (load(argv[2], &a) < 0 || load(argv[3], &b) < 0) {
+            return EXIT_FAILURE;
+        }
+        diff(&a, &b);
+    } else {
+        return usage();
+    }
+    return EXIT_SUCCESS;
+}
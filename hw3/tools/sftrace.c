@@ -0,0 +1,305 @@
+/*
+ * Reader for allocation traces written by sf_trace_start()/sf_trace_stop().
+ *
+ *   sftrace summary FILE      calls per operation and thread, sizes, drops
+ *   sftrace replay [-r SIZE] FILE
+ *                             runs the trace against this build of the allocator
+ *
+ * Replay issues the calls in time order from a single thread, so a trace taken
+ * from any build can be used to compare placement policies on the same workload.
+ * It runs on an mmap-backed heap that may grow to SIZE bytes (K, M or G suffix),
+ * by default SF_DEFAULT_RESERVE.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "sfmm_internal.h"
+#include "sfpage.h"
+#include "sfhist.h"
+#include "sftrace.h"
+
+#define NUM_OPS 4
+
+static const char *op_names[NUM_OPS] = { "malloc", "free", "realloc", "memalign" };
+
+typedef struct trace {
+    sf_trace_header hdr;
+    sf_trace_event *events;
+} trace;
+
+static int load(const char *path, trace *t) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&t->hdr, sizeof(t->hdr), 1, f) != 1 || t->hdr.magic != SF_TRACE_MAGIC
+        || t->hdr.version != SF_TRACE_VERSION || t->hdr.event_size != sizeof(sf_trace_event)) {
+        fprintf(stderr, "%s: not a version %d allocation trace\n", path, SF_TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    // the count is only believed as far as the file has events for it
+    struct stat st;
+    if (fstat(fileno(f), &st) < 0 || st.st_size < (off_t)sizeof(t->hdr)
+        || t->hdr.num_events > (SIZE_MAX - 1) / sizeof(sf_trace_event)
+        || t->hdr.num_events > (uint64_t)(st.st_size - sizeof(t->hdr)) / sizeof(sf_trace_event)) {
+        fprintf(stderr, "%s: truncated trace\n", path);
+        fclose(f);
+        return -1;
+    }
+    t->events = malloc(t->hdr.num_events * sizeof(sf_trace_event) + 1);
+    if (t->events == NULL
+        || fread(t->events, sizeof(sf_trace_event), t->hdr.num_events, f) != t->hdr.num_events) {
+        fprintf(stderr, "%s: truncated trace\n", path);
+        free(t->events);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int by_time(const void *a, const void *b) {
+    const sf_trace_event *x = a, *y = b;
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    return (int)x->thread - (int)y->thread;
+}
+
+static void summary(const trace *t) {
+    uint64_t calls[NUM_OPS] = { 0 }, bytes[NUM_OPS] = { 0 }, largest = 0;
+    uint64_t first = UINT64_MAX, last = 0;
+    unsigned threads = 0;
+    uint64_t i;
+    for (i = 0; i < t->hdr.num_events; i++) {
+        const sf_trace_event *e = &t->events[i];
+        if (e->op >= NUM_OPS) {
+            continue;
+        }
+        calls[e->op]++;
+        bytes[e->op] += e->size;
+        if (e->size > largest) {
+            largest = e->size;
+        }
+        if (e->time < first) {
+            first = e->time;
+        }
+        if (e->time > last) {
+            last = e->time;
+        }
+        if (e->thread + 1u > threads) {
+            threads = e->thread + 1u;
+        }
+    }
+    printf("events          %10llu (%llu dropped)\n",
+           (unsigned long long)t->hdr.num_events, (unsigned long long)t->hdr.dropped);
+    printf("threads         %10u\n", threads);
+    printf("duration        %10llu %s\n", (unsigned long long)(last >= first ? last - first : 0),
+           t->hdr.clock == SF_TRACE_CLOCK_TSC ? "cycles" : "ns");
+    for (i = 0; i < NUM_OPS; i++) {
+        printf("%-15s %10llu calls", op_names[i], (unsigned long long)calls[i]);
+        if (i != SF_OP_FREE && calls[i] != 0) {
+            printf(", %llu bytes (mean %llu)", (unsigned long long)bytes[i],
+                   (unsigned long long)(bytes[i] / calls[i]));
+        }
+        printf("\n");
+    }
+    printf("largest request %10llu bytes\n", (unsigned long long)largest);
+}
+
+/*
+ * Traced pointers to the ones replay got back, open addressing with linear
+ * probing.  Removed entries keep their slot with to == NULL, so probing past
+ * them still works.
+ */
+typedef struct ptr_map {
+    uint64_t *from;
+    void **to;
+    size_t mask;
+} ptr_map;
+
+static size_t slot(const ptr_map *m, uint64_t from) {
+    size_t i = (size_t)((from >> 6) * 0x9e3779b97f4a7c15ull) & m->mask;
+    while (m->from[i] != 0 && m->from[i] != from) {
+        i = (i + 1) & m->mask;
+    }
+    return i;
+}
+
+static void map_put(ptr_map *m, uint64_t from, void *to) {
+    size_t i = slot(m, from);
+    m->from[i] = from;
+    m->to[i] = to;
+}
+
+static void *map_take(ptr_map *m, uint64_t from) {
+    size_t i = slot(m, from);
+    void *to = m->to[i];
+    m->to[i] = NULL;
+    return to;
+}
+
+static int replay(trace *t, size_t reserve) {
+    ptr_map m;
+    size_t cap = 64;
+    // every distinct pointer the trace returned takes one slot; keep it under half full
+    while (cap < 2 * t->hdr.num_events + 2) {
+        cap *= 2;
+    }
+    m.from = calloc(cap, sizeof(uint64_t));
+    m.to = calloc(cap, sizeof(void *));
+    m.mask = cap - 1;
+    if (m.from == NULL || m.to == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    qsort(t->events, t->hdr.num_events, sizeof(sf_trace_event), by_time);
+
+    if (sf_set_page_provider(&sf_mmap_pages, reserve) < 0) {
+        fprintf(stderr, "cannot set up the heap\n");
+        return -1;
+    }
+    uint64_t failed = 0, unmatched = 0, peak_heap = 0;
+    size_t live = 0, peak_live = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t i;
+    for (i = 0; i < t->hdr.num_events; i++) {
+        const sf_trace_event *e = &t->events[i];
+        void *p = NULL, *q;
+        switch (e->op) {
+        case SF_OP_MALLOC:
+        case SF_OP_MEMALIGN:
+            if (e->ptr == 0) {
+                continue; // failed when traced too
+            }
+            p = e->op == SF_OP_MALLOC ? sf_malloc(e->size) : sf_memalign(e->size, e->align);
+            if (p == NULL) {
+                failed++;
+                continue;
+            }
+            live += sf_malloc_usable_size(p);
+            map_put(&m, e->ptr, p);
+            break;
+        case SF_OP_FREE:
+            if (e->ptr == 0) {
+                continue;
+            }
+            if ((q = map_take(&m, e->ptr)) == NULL) {
+                unmatched++; // allocated before the trace started
+                continue;
+            }
+            live -= sf_malloc_usable_size(q);
+            sf_free(q);
+            break;
+        case SF_OP_REALLOC:
+            if (e->ptr == 0 && e->size != 0) {
+                continue; // failed when traced too, and the old block stayed
+            }
+            q = e->old != 0 ? map_take(&m, e->old) : NULL;
+            if (e->old != 0 && q == NULL) {
+                unmatched++;
+                continue;
+            }
+            if (q != NULL) {
+                live -= sf_malloc_usable_size(q);
+            }
+            p = sf_realloc(q, e->size);
+            if (p == NULL) {
+                if (e->ptr != 0) {
+                    failed++;
+                }
+                if (q != NULL && e->size != 0) {
+                    // the old block is still there
+                    live += sf_malloc_usable_size(q);
+                    map_put(&m, e->old, q);
+                }
+                continue;
+            }
+            if (e->ptr == 0) {
+                // the traced call returned nothing, so nothing will free this
+                sf_free(p);
+                continue;
+            }
+            live += sf_malloc_usable_size(p);
+            map_put(&m, e->ptr, p);
+            break;
+        default:
+            continue;
+        }
+        uint64_t heap = (uint64_t)((char *)sf_heap_end() - (char *)sf_heap_start());
+        if (heap > peak_heap) {
+            peak_heap = heap;
+        }
+        if (live > peak_live) {
+            peak_live = live;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    uint64_t heap = (uint64_t)((char *)sf_heap_end() - (char *)sf_heap_start());
+    printf("replayed        %10llu events in %.3f ms\n", (unsigned long long)t->hdr.num_events,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    printf("failed          %10llu calls\n", (unsigned long long)failed);
+    printf("unmatched       %10llu frees of blocks from before the trace\n", (unsigned long long)unmatched);
+    printf("heap size       %10llu bytes (peak %llu)\n", (unsigned long long)heap, (unsigned long long)peak_heap);
+    printf("live            %10zu bytes (peak %zu)\n", live, peak_live);
+    // share of the heap at its largest that was never holding payload at once
+    printf("overhead        %9.1f%%\n", peak_heap ? 100.0 * (peak_heap - peak_live) / peak_heap : 0.0);
+    sf_set_page_provider(&sf_sfutil_pages, 0);
+    free(m.from);
+    free(m.to);
+    return 0;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: sftrace summary FILE\n"
+                    "       sftrace replay [-r SIZE] FILE\n");
+    return EXIT_FAILURE;
+}
+
+// SIZE as given to -r: bytes, or K, M or G of them.  @return 0 if it does not parse.
+static size_t parse_size(const char *arg) {
+    char *end;
+    unsigned long long n = strtoull(arg, &end, 10);
+    int shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    }
+    if (end == arg || *end != '\0' || n > (SIZE_MAX >> shift)) {
+        return 0;
+    }
+    return (size_t)n << shift;
+}
+
+int main(int argc, char const *argv[]) {
+    trace t;
+    if (argc == 3 && strcmp(argv[1], "summary") == 0) {
+        if (load(argv[2], &t) < 0) {
+            return EXIT_FAILURE;
+        }
+        summary(&t);
+    } else if ((argc == 3 || argc == 5) && strcmp(argv[1], "replay") == 0) {
+        size_t reserve = SF_DEFAULT_RESERVE;
+        if (argc == 5) {
+            if (strcmp(argv[2], "-r") != 0 || (reserve = parse_size(argv[3])) == 0) {
+                return usage();
+            }
+        }
+        if (load(argv[argc - 1], &t) < 0 || replay(&t, reserve) < 0) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        return usage();
+    }
+    return EXIT_SUCCESS;
+}